@@ -0,0 +1,264 @@
+/*
+ * Quadratic Sinusoidal Analysis.
+ * Copyright (C) 2018 OpenQSA.
+ * 
+ * This file is part of OpenQSA.
+ * 
+ * OpenQSA is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ * 
+ * OpenQSA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with OpenQSA.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "analysis.h"
+
+#include "kernelaverage.h"
+
+#include <algorithm>
+#include <cmath>
+#include <optional>
+
+namespace Qsa
+{
+Analysis::Analysis(
+        const Intermodulation & intermodulation,
+        double dt,
+        double duration)
+:
+        generators_(
+                intermodulation.generators().begin(),
+                intermodulation.generators().end()),
+        duration_(duration),
+        period_(std::lround(duration / dt)),
+        fft_(period_)
+{
+        // Linear response at generators, quadratic response at products
+        bins_ = generators_;
+        bins_.insert(
+                bins_.end(),
+                intermodulation.products().begin(),
+                intermodulation.products().end());
+        std::sort(bins_.begin(), bins_.end());
+        bins_.erase(std::unique(bins_.begin(), bins_.end()), bins_.end());
+}
+
+Analysis::Kernels Analysis::estimate(const Recording::Trace & trace) const
+{
+        return kernels(coefficients(trace));
+}
+
+Analysis::Kernels Analysis::estimate(const Recording & recording) const
+{
+        return estimate(recording.traces());
+}
+
+Analysis::Kernels Analysis::estimate(
+        const Recording & recording,
+        ThreadPool & pool) const
+{
+        return estimate(recording.traces(), pool);
+}
+
+Analysis::Kernels Analysis::estimate(
+        const std::vector<Recording::Trace> & traces) const
+{
+        KernelAverage average(*this);
+        for (const auto & trace : traces)
+                average.add(estimate(trace));
+        return average.kernels();
+}
+
+Analysis::Kernels Analysis::estimate(
+        const std::vector<Recording::Trace> & traces,
+        ThreadPool & pool) const
+{
+        // Estimate kernels trace by trace, traces being split across threads
+        std::vector<Kernels> estimates(traces.size());
+        pool.parallel_for(traces.size(), [&](std::size_t i)
+        {
+                estimates[i] = estimate(traces[i]);
+        });
+
+        // Average estimates over traces
+        KernelAverage average(*this);
+        for (const auto & estimate : estimates)
+                average.add(estimate);
+        return average.kernels();
+}
+
+Analysis::Kernels Analysis::estimate_file(
+        const std::string & filename,
+        ThreadPool & pool)
+{
+        std::optional<Analysis> analysis;
+        std::optional<KernelAverage> average;
+        auto start = [&](const StimulationDescriptor & stimulation)
+        {
+                const auto & frequencies = stimulation.frequencies();
+                analysis.emplace(
+                        frequencies.intermodulation(),
+                        frequencies.dt(),
+                        frequencies.duration());
+                average.emplace(*analysis);
+        };
+
+        // Traces estimated a batch at a time, averaged in file order
+        std::vector<Recording::Trace> batch;
+        std::vector<Kernels> estimates;
+        auto batch_size = std::max<std::size_t>(pool.size(), 1);
+        auto flush = [&]()
+        {
+                estimates.resize(batch.size());
+                pool.parallel_for(batch.size(), [&](std::size_t i)
+                {
+                        estimates[i] = analysis->estimate(batch[i]);
+                });
+                for (const auto & estimate : estimates)
+                        average->add(estimate);
+                batch.clear();
+        };
+        auto stimulation = Recording::stream(
+                filename,
+                [&](
+                        const StimulationDescriptor & stimulation,
+                        Recording::Trace & trace)
+                {
+                        if (!analysis)
+                                start(stimulation);
+                        batch.push_back(std::move(trace));
+                        if (batch.size() == batch_size)
+                                flush();
+                });
+        if (!analysis)
+                start(*stimulation);
+        flush();
+        return average->kernels();
+}
+
+Analysis::Coefficients Analysis::coefficients(
+        const Recording::Trace & trace) const
+{
+        Coefficients result;
+        const auto & spectrum = trace.spectrum_;
+        const auto & multisine = trace.multisine_;
+        std::vector<int> bins;
+        std::vector<std::complex<double>> stimulation;
+        std::vector<std::complex<double>> response;
+        if (!spectrum.bins_.empty())
+        {
+                // Already computed online by the recorder
+                bins = spectrum.bins_;
+                stimulation = spectrum.stimulation_;
+                response = spectrum.response_;
+        }
+        else if (multisine.response_.size() >= period_ && period_ > 0)
+        {
+                // FFT of the first steady-state period, gathered at every bin
+                std::vector<std::complex<double>> x(period_ / 2 + 1);
+                std::vector<std::complex<double>> y(period_ / 2 + 1);
+                fft_.forward_real(multisine.stimulation_.data(), x.data());
+                fft_.forward_real(multisine.response_.data(), y.data());
+                auto gather = [&](
+                        const std::vector<std::complex<double>> & spectrum,
+                        int bin)
+                {
+                        // Bins past Nyquist fold back as conjugates
+                        std::size_t k = bin % period_;
+                        auto value = k <= period_ / 2 ?
+                                spectrum[k] :
+                                std::conj(spectrum[period_ - k]);
+                        return value / double(period_);
+                };
+                bins = bins_;
+                for (auto bin : bins_)
+                {
+                        stimulation.push_back(gather(x, bin));
+                        response.push_back(gather(y, bin));
+                }
+        }
+        else
+                return result; // Incomplete trace
+
+        for (std::size_t b = 0; b < bins.size(); b++)
+                result.response_[bins[b]] = response[b];
+        for (auto k : generators_)
+        {
+                auto it = std::lower_bound(bins.begin(), bins.end(), k);
+                if (it == bins.end() || *it != k)
+                        return {};
+                result.stimulation_.push_back(stimulation[it - bins.begin()]);
+        }
+        return result;
+}
+
+Analysis::Kernels Analysis::kernels(const Coefficients & coefficients) const
+{
+        auto n = generators_.size();
+        Kernels result;
+        result.generators_ = generators_;
+        for (auto k : generators_)
+                result.frequencies_.push_back(k / duration_);
+        result.size_ = 2 * n;
+        result.linear_.resize(n);
+        result.quadratic_.resize(4 * n * n);
+        result.linear_error_.resize(n);
+        result.quadratic_error_.resize(4 * n * n);
+        if (coefficients.stimulation_.size() != n)
+                return result; // Nothing to estimate from
+        result.trace_count_ = 1;
+
+        const auto & x = coefficients.stimulation_;
+        auto y = [&](int bin)
+        {
+                auto it = coefficients.response_.find(bin);
+                return it == coefficients.response_.end() ?
+                        std::complex<double>{} : it->second;
+        };
+
+        // Linear response at each generator
+        for (std::size_t i = 0; i < n; i++)
+                result.linear_[i] = y(generators_[i]) / x[i];
+
+        // Quadratic response to components (i, si) and (j, sj), signs being
+        // +1 for positive and -1 for negative frequencies
+        auto h2 = [&](std::size_t i, int si, std::size_t j, int sj)
+        {
+                auto m = si * generators_[i] + sj * generators_[j];
+                if (m == 0)
+                        return std::complex<double>{};
+                auto conjugate = m < 0;
+                if (conjugate)
+                {
+                        si = -si;
+                        sj = -sj;
+                }
+                auto xi = si > 0 ? x[i] : std::conj(x[i]);
+                auto xj = sj > 0 ? x[j] : std::conj(x[j]);
+                auto c = i == j && si == sj ? 1.0 : 2.0;
+                auto value = y(std::abs(m)) / (c * xi * xj);
+                return conjugate ? std::conj(value) : value;
+        };
+
+        // QSA matrix Q(a, b) = H2(fa, -fb) over [f1 .. fn, -f1 .. -fn]
+        for (std::size_t a = 0; a < 2 * n; a++)
+        {
+                auto i = a % n;
+                auto si = a < n ? +1 : -1;
+                for (std::size_t b = 0; b < 2 * n; b++)
+                {
+                        auto j = b % n;
+                        auto sj = b < n ? -1 : +1;
+                        result.quadratic_[a * 2 * n + b] = h2(i, si, j, sj);
+                }
+        }
+        return result;
+}
+}
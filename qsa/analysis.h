@@ -0,0 +1,101 @@
+/*
+ * Quadratic Sinusoidal Analysis.
+ * Copyright (C) 2018 OpenQSA.
+ * 
+ * This file is part of OpenQSA.
+ * 
+ * OpenQSA is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ * 
+ * OpenQSA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with OpenQSA.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef QSA_ANALYSIS_H
+#define QSA_ANALYSIS_H
+
+#include "fft.h"
+#include "intermodulation.h"
+#include "recording.h"
+#include "threadpool.h"
+
+#include <complex>
+#include <cstddef>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace Qsa
+{
+// Estimates QSA kernels from the steady-state multisine period of each trace.
+// The quadratic matrix is indexed by the frequencies [f1 .. fn, -f1 .. -fn],
+// with Q(a, b) = H2(fa, -fb). The diagonal (DC) entries are not identifiable
+// from a single multisine and are left at zero. Kernels are averaged over
+// traces, errors being the standard errors of these averages.
+class Analysis
+{
+public:
+        struct Kernels
+        {
+                std::vector<int> generators_;
+                std::vector<double> frequencies_; // in hertz
+                std::vector<std::complex<double>> linear_;
+                std::vector<std::complex<double>> quadratic_; // row-major
+                std::vector<double> linear_error_;
+                std::vector<double> quadratic_error_;
+                std::size_t size_{}; // quadratic matrix is size_ x size_
+                std::size_t trace_count_{};
+        };
+
+        Analysis(const Analysis &) = default;
+        Analysis & operator=(const Analysis &) = default;
+        ~Analysis() = default;
+
+        explicit Analysis(
+                const Intermodulation & intermodulation,
+                double dt,
+                double duration);
+
+        Kernels estimate(const Recording::Trace & trace) const;
+        // Traces on the calling thread, or split across the threads of pool
+        Kernels estimate(const Recording & recording) const;
+        Kernels estimate(const Recording & recording, ThreadPool & pool)
+                const;
+        Kernels estimate(const std::vector<Recording::Trace> & traces) const;
+        Kernels estimate(
+                const std::vector<Recording::Trace> & traces,
+                ThreadPool & pool) const;
+        // Reads a saved recording trace by trace, as many traces as pool has
+        // threads being estimated at once, which bounds memory
+        static Kernels estimate_file(
+                const std::string & filename,
+                ThreadPool & pool);
+
+private:
+        struct Coefficients
+        {
+                std::vector<std::complex<double>> stimulation_;
+                std::map<int, std::complex<double>> response_;
+        };
+
+        Coefficients coefficients(const Recording::Trace & trace) const;
+        Kernels kernels(const Coefficients & coefficients) const;
+
+        std::vector<int> generators_;
+        std::vector<int> bins_;
+        double duration_;
+        std::size_t period_;
+        Fft fft_;
+
+        friend class KernelAverage;
+};
+}
+
+#endif /* QSA_ANALYSIS_H */
@@ -0,0 +1,143 @@
+/*
+ * Quadratic Sinusoidal Analysis.
+ * Copyright (C) 2018 OpenQSA.
+ * 
+ * This file is part of OpenQSA.
+ * 
+ * OpenQSA is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ * 
+ * OpenQSA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with OpenQSA.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "buildtask.h"
+
+#include <exception>
+
+namespace Qsa
+{
+BuildTask::~BuildTask()
+{
+        // Nobody is left to use the stimulation
+        cancel();
+        wait();
+}
+
+BuildTask::BuildTask(
+        const StimulationBuilder & builder,
+        int channel_count,
+        const Completion & completion)
+:
+        job_([builder, channel_count](
+                const StimulationBuilder::Progress & progress)
+        {
+                return builder.build_channels(channel_count, progress);
+        }),
+        completion_(completion),
+        built_(false),
+        cancelled_(false),
+        finished_(false),
+        progress_(0.0),
+        stage_(StimulationBuilder::STAGE_INTERMODULATION)
+{
+        // Thread is started last, once every member is initialized
+        thread_ = std::thread(&BuildTask::run, this);
+}
+
+BuildTask::BuildTask(
+        std::shared_ptr<const MultichannelStimulation> stimulation,
+        double dt,
+        const Completion & completion)
+:
+        job_([stimulation, dt](const StimulationBuilder::Progress & progress)
+        {
+                return StimulationBuilder::resample(*stimulation, dt, progress);
+        }),
+        completion_(completion),
+        built_(false),
+        cancelled_(false),
+        finished_(false),
+        progress_(0.0),
+        stage_(StimulationBuilder::STAGE_SYNTHESIS)
+{
+        thread_ = std::thread(&BuildTask::run, this);
+}
+
+bool BuildTask::built() const
+{
+        return built_;
+}
+
+void BuildTask::cancel()
+{
+        cancelled_ = true;
+}
+
+bool BuildTask::cancelled() const
+{
+        return cancelled_;
+}
+
+bool BuildTask::finished() const
+{
+        return finished_;
+}
+
+double BuildTask::progress() const
+{
+        return progress_;
+}
+
+StimulationBuilder::Stage BuildTask::stage() const
+{
+        return stage_;
+}
+
+std::shared_ptr<MultichannelStimulation> BuildTask::stimulation() const
+{
+        // Written by the background thread before it finishes
+        return finished_ ? stimulation_ : nullptr;
+}
+
+void BuildTask::wait()
+{
+        if (thread_.joinable())
+                thread_.join();
+}
+
+void BuildTask::run()
+{
+        auto progress = [this](StimulationBuilder::Stage stage, double fraction)
+        {
+                stage_ = stage;
+                progress_ = fraction;
+                return !cancelled_;
+        };
+        try
+        {
+                auto stimulation = job_(progress);
+                if (stimulation.channel_count() > 0 && !cancelled_)
+                {
+                        stimulation_ =
+                                std::make_shared<MultichannelStimulation>(
+                                        std::move(stimulation));
+                        built_ = true;
+                }
+        }
+        catch (const std::exception &)
+        {
+                // Left unbuilt, e.g. for lack of memory
+        }
+        finished_ = true;
+        if (completion_)
+                completion_(built_);
+}
+}
@@ -0,0 +1,85 @@
+/*
+ * Quadratic Sinusoidal Analysis.
+ * Copyright (C) 2018 OpenQSA.
+ * 
+ * This file is part of OpenQSA.
+ * 
+ * OpenQSA is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ * 
+ * OpenQSA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with OpenQSA.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef QSA_BUILDTASK_H
+#define QSA_BUILDTASK_H
+
+#include "multichannelstimulation.h"
+#include "stimulationbuilder.h"
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <thread>
+
+namespace Qsa
+{
+// Builds a stimulation on a background thread, so that large ones do not hold
+// up the GUI. Destruction waits for the thread: a task being superseded is
+// cancelled, then kept until finished() rather than destroyed right away.
+class BuildTask
+{
+public:
+        // Called from the background thread once the task is over
+        using Completion = std::function<void(bool built)>;
+
+        BuildTask(const BuildTask &) = delete;
+        BuildTask & operator=(const BuildTask &) = delete;
+        ~BuildTask();
+
+        explicit BuildTask(
+                const StimulationBuilder & builder,
+                int channel_count = 1,
+                const Completion & completion = {});
+        // Resamples a stimulation, see StimulationBuilder::resample()
+        explicit BuildTask(
+                std::shared_ptr<const MultichannelStimulation> stimulation,
+                double dt,
+                const Completion & completion = {});
+
+        bool built() const;
+        void cancel();
+        bool cancelled() const;
+        bool finished() const;
+        double progress() const; // of the current stage
+        StimulationBuilder::Stage stage() const;
+        // Null until built
+        std::shared_ptr<MultichannelStimulation> stimulation() const;
+        void wait();
+
+private:
+        using Job = std::function<MultichannelStimulation(
+                const StimulationBuilder::Progress & progress)>;
+
+        void run();
+
+        Job job_;
+        Completion completion_;
+        std::atomic<bool> built_;
+        std::atomic<bool> cancelled_;
+        std::atomic<bool> finished_;
+        std::atomic<double> progress_;
+        std::atomic<StimulationBuilder::Stage> stage_;
+        std::shared_ptr<MultichannelStimulation> stimulation_;
+        std::thread thread_;
+};
+}
+
+#endif /* QSA_BUILDTASK_H */
@@ -0,0 +1,87 @@
+/*
+ * Quadratic Sinusoidal Analysis.
+ * Copyright (C) 2018 OpenQSA.
+ * 
+ * This file is part of OpenQSA.
+ * 
+ * OpenQSA is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ * 
+ * OpenQSA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with OpenQSA.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "decimatingring.h"
+
+#include <algorithm>
+
+namespace Qsa
+{
+DecimatingRing::DecimatingRing(std::size_t capacity, std::size_t decimation)
+:
+        buckets_(std::max<std::size_t>(capacity, 1)),
+        head_(0),
+        tail_(0),
+        decimation_(std::max<std::size_t>(decimation, 1)),
+        dropped_(0),
+        count_(0)
+{
+}
+
+std::size_t DecimatingRing::decimation() const
+{
+        return decimation_;
+}
+
+std::size_t DecimatingRing::dropped() const
+{
+        return dropped_;
+}
+
+std::size_t DecimatingRing::pop(std::vector<Bucket> & buckets)
+{
+        auto tail = tail_.load(std::memory_order_relaxed);
+        auto head = head_.load(std::memory_order_acquire);
+        for (auto i = tail; i != head; i++)
+                buckets.push_back(buckets_[i % buckets_.size()]);
+        tail_.store(head, std::memory_order_release);
+        return head - tail;
+}
+
+void DecimatingRing::push(double sample)
+{
+        if (count_ == 0)
+                current_ = {sample, sample};
+        else
+        {
+                current_.min_ = std::min(current_.min_, sample);
+                current_.max_ = std::max(current_.max_, sample);
+        }
+        if (++count_ < decimation_.load(std::memory_order_relaxed))
+                return;
+
+        // Bucket complete, unless the consumer lags a whole ring behind
+        count_ = 0;
+        auto head = head_.load(std::memory_order_relaxed);
+        auto tail = tail_.load(std::memory_order_acquire);
+        if (head - tail == buckets_.size())
+        {
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+                return;
+        }
+        buckets_[head % buckets_.size()] = current_;
+        head_.store(head + 1, std::memory_order_release);
+}
+
+void DecimatingRing::set_decimation(std::size_t decimation)
+{
+        decimation_ = std::max<std::size_t>(decimation, 1);
+}
+}
@@ -0,0 +1,73 @@
+/*
+ * Quadratic Sinusoidal Analysis.
+ * Copyright (C) 2018 OpenQSA.
+ * 
+ * This file is part of OpenQSA.
+ * 
+ * OpenQSA is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ * 
+ * OpenQSA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with OpenQSA.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef QSA_DECIMATINGRING_H
+#define QSA_DECIMATINGRING_H
+
+#include "waveformpyramid.h"
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+namespace Qsa
+{
+// Minimum and maximum of a signal over every decimation samples, handed from
+// one producer, typically the real-time thread, to one consumer, typically
+// the GUI. Neither ever waits for the other: buckets are dropped while the
+// ring is full.
+class DecimatingRing
+{
+public:
+        using Bucket = WaveformPyramid::Bucket;
+
+        DecimatingRing(const DecimatingRing &) = delete;
+        DecimatingRing & operator=(const DecimatingRing &) = delete;
+        ~DecimatingRing() = default;
+
+        explicit DecimatingRing(
+                std::size_t capacity = 4096,
+                std::size_t decimation = 1);
+
+        std::size_t decimation() const;
+        // Since construction, the ring being full
+        std::size_t dropped() const;
+        // Consumer side, appends buckets completed since the last call and
+        // returns how many
+        std::size_t pop(std::vector<Bucket> & buckets);
+        // Producer side
+        void push(double sample);
+        // Consumer side, from the next bucket on
+        void set_decimation(std::size_t decimation);
+
+private:
+        std::vector<Bucket> buckets_;
+        // Buckets written and read, wrapping around buckets_
+        std::atomic<std::size_t> head_;
+        std::atomic<std::size_t> tail_;
+        std::atomic<std::size_t> decimation_;
+        std::atomic<std::size_t> dropped_;
+        // Bucket being accumulated by the producer
+        Bucket current_;
+        std::size_t count_;
+};
+}
+
+#endif /* QSA_DECIMATINGRING_H */
@@ -0,0 +1,459 @@
+/*
+ * Quadratic Sinusoidal Analysis.
+ * Copyright (C) 2018 OpenQSA.
+ * 
+ * This file is part of OpenQSA.
+ * 
+ * OpenQSA is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ * 
+ * OpenQSA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with OpenQSA.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "eigensolver.h"
+#include "threadpool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <random>
+
+namespace
+{
+using Complex = std::complex<double>;
+
+const double EPSILON = std::numeric_limits<double>::epsilon();
+
+// Implicit QL sweeps allowed per eigenvalue before giving up on it
+const int MAX_ITERATIONS = 60;
+
+// Inverse iteration steps per eigenvector
+const int INVERSE_ITERATIONS = 3;
+
+// Plain complex products (std::complex ones handle infinities, which is slow)
+inline Complex multiply(Complex a, Complex b)
+{
+        return {
+                a.real() * b.real() - a.imag() * b.imag(),
+                a.real() * b.imag() + a.imag() * b.real()};
+}
+
+inline Complex multiply_conj(Complex a, Complex b)
+{
+        return {
+                a.real() * b.real() + a.imag() * b.imag(),
+                a.imag() * b.real() - a.real() * b.imag()};
+}
+
+// A = Q D S D* Q*, with S real symmetric tridiagonal, D diagonal unitary and
+// Q the product of the Householder reflections I - u u*
+struct Tridiagonal
+{
+        std::vector<double> diagonal;
+        std::vector<double> offdiagonal; // offdiagonal[i] = S(i + 1, i)
+        std::vector<Complex> phases;
+        std::vector<std::vector<Complex>> reflectors;
+};
+
+Tridiagonal reduce(const Complex * matrix, std::size_t n)
+{
+        Tridiagonal result;
+        std::vector<Complex> a(matrix, matrix + n * n);
+        std::vector<Complex> p(n);
+        result.reflectors.resize(n > 2 ? n - 2 : 0);
+        for (std::size_t k = 0; k + 2 < n; k++)
+        {
+                // Reflection zeroing column k below the subdiagonal
+                auto first = k + 1;
+                auto m = n - first;
+                double norm = 0;
+                for (std::size_t r = 0; r < m; r++)
+                        norm += std::norm(a[(first + r) * n + k]);
+                if (norm == 0)
+                        continue;
+                norm = std::sqrt(norm);
+                auto alpha = a[first * n + k];
+                auto magnitude = std::abs(alpha);
+                auto phase = magnitude == 0 ? Complex(1) : alpha / magnitude;
+                auto & u = result.reflectors[k];
+                u.resize(m);
+                for (std::size_t r = 0; r < m; r++)
+                        u[r] = a[(first + r) * n + k];
+                u[0] += phase * norm;
+                auto scale = 1 / std::sqrt(norm * (norm + magnitude));
+                for (auto & value : u)
+                        value *= scale;
+                a[first * n + k] = -phase * norm;
+
+                // Trailing block B <- B - u q* - q u*, with p = B u and
+                // q = p - (u* p / 2) u
+                double half = 0;
+                for (std::size_t i = 0; i < m; i++)
+                {
+                        const auto * row = a.data() + (first + i) * n + first;
+                        Complex sum;
+                        for (std::size_t j = 0; j < m; j++)
+                                sum += multiply(row[j], u[j]);
+                        p[i] = sum;
+                        half += multiply_conj(sum, u[i]).real();
+                }
+                half /= 2;
+                for (std::size_t i = 0; i < m; i++)
+                        p[i] -= half * u[i];
+                for (std::size_t i = 0; i < m; i++)
+                {
+                        auto * row = a.data() + (first + i) * n + first;
+                        auto ui = u[i];
+                        auto pi = p[i];
+                        for (std::size_t j = 0; j < m; j++)
+                                row[j] -= multiply_conj(ui, p[j]) +
+                                        multiply_conj(pi, u[j]);
+                }
+        }
+
+        // Phases making the subdiagonal real and nonnegative
+        result.diagonal.resize(n);
+        result.offdiagonal.resize(n);
+        result.phases.resize(n, 1);
+        for (std::size_t i = 0; i < n; i++)
+                result.diagonal[i] = a[i * n + i].real();
+        for (std::size_t i = 0; i + 1 < n; i++)
+        {
+                auto t = a[(i + 1) * n + i];
+                auto magnitude = std::abs(t);
+                result.offdiagonal[i] = magnitude;
+                result.phases[i + 1] = magnitude == 0 ?
+                        result.phases[i] :
+                        result.phases[i] * t / magnitude;
+        }
+        return result;
+}
+
+// Implicit QL on a symmetric tridiagonal matrix, eigenvalues replacing the
+// diagonal. Rows of vectors, if any, are rotated along.
+void diagonalize(
+        std::vector<double> & d,
+        std::vector<double> & e,
+        std::vector<double> * vectors)
+{
+        auto n = d.size();
+        for (std::size_t l = 0; l < n; l++)
+        {
+                for (auto iteration = 0; iteration < MAX_ITERATIONS;
+                        iteration++)
+                {
+                        auto m = l;
+                        for (; m + 1 < n; m++)
+                        {
+                                auto dd = std::abs(d[m]) + std::abs(d[m + 1]);
+                                if (std::abs(e[m]) <= EPSILON * dd)
+                                        break;
+                        }
+                        if (m == l)
+                                break;
+
+                        auto g = (d[l + 1] - d[l]) / (2 * e[l]);
+                        auto r = std::hypot(g, 1.0);
+                        g = d[m] - d[l] + e[l] / (g + std::copysign(r, g));
+                        double s = 1;
+                        double c = 1;
+                        double p = 0;
+                        auto deflated = false;
+                        for (auto i = m; i-- > l;)
+                        {
+                                auto f = s * e[i];
+                                auto b = c * e[i];
+                                r = std::hypot(f, g);
+                                e[i + 1] = r;
+                                if (r == 0)
+                                {
+                                        d[i + 1] -= p;
+                                        e[m] = 0;
+                                        deflated = true;
+                                        break;
+                                }
+                                s = f / r;
+                                c = g / r;
+                                g = d[i + 1] - p;
+                                r = (d[i] - g) * s + 2 * c * b;
+                                p = s * r;
+                                d[i + 1] = g + p;
+                                g = c * r - b;
+                                if (vectors == nullptr)
+                                        continue;
+                                auto * zi = vectors->data() + i * n;
+                                auto * zj = zi + n;
+                                for (std::size_t k = 0; k < n; k++)
+                                {
+                                        auto t = zj[k];
+                                        zj[k] = s * zi[k] + c * t;
+                                        zi[k] = c * zi[k] - s * t;
+                                }
+                        }
+                        if (deflated)
+                                continue;
+                        d[l] -= p;
+                        e[l] = g;
+                        e[m] = 0;
+                }
+        }
+}
+
+// Eigenvectors of a symmetric tridiagonal matrix for the given eigenvalues,
+// by inverse iteration. Vectors of close eigenvalues are orthogonalized
+// against each other, and equal eigenvalues are slightly separated.
+std::vector<std::vector<double>> inverse_iteration(
+        const std::vector<double> & d,
+        const std::vector<double> & e,
+        const std::vector<double> & values)
+{
+        auto n = d.size();
+        double norm = 0;
+        for (std::size_t i = 0; i < n; i++)
+                norm = std::max(
+                        norm,
+                        std::abs(d[i]) + e[i] + (i > 0 ? e[i - 1] : 0));
+        auto tiny = norm > 0 ? EPSILON * norm :
+                std::numeric_limits<double>::min();
+        auto separation = 10 * EPSILON * norm;
+        auto cluster = 1e-3 * norm;
+
+        std::vector<std::size_t> order(values.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(), [&](auto i, auto j)
+        {
+                return values[i] < values[j];
+        });
+
+        std::vector<std::vector<double>> result(values.size());
+        std::minstd_rand generator;
+        std::uniform_real_distribution<double> distribution(-1, 1);
+        std::vector<double> lower(n), diagonal(n), upper(n), upper2(n);
+        std::vector<bool> swapped(n);
+        auto first = order.begin(); // of the current cluster
+        auto previous = 0.0;
+        for (auto it = order.begin(); it != order.end(); ++it)
+        {
+                auto value = values[*it];
+                if (it != order.begin())
+                {
+                        if (value - values[*(it - 1)] > cluster)
+                                first = it;
+                        value = std::max(value, previous + separation);
+                }
+                previous = value;
+
+                // LU factorization of S - value I with partial pivoting
+                for (std::size_t i = 0; i < n; i++)
+                {
+                        diagonal[i] = d[i] - value;
+                        lower[i] = upper[i] = e[i];
+                        upper2[i] = 0;
+                }
+                for (std::size_t i = 0; i + 1 < n; i++)
+                {
+                        swapped[i] = std::abs(diagonal[i]) < std::abs(lower[i]);
+                        if (!swapped[i])
+                        {
+                                if (diagonal[i] == 0)
+                                        diagonal[i] = tiny;
+                                lower[i] /= diagonal[i];
+                                diagonal[i + 1] -= lower[i] * upper[i];
+                                continue;
+                        }
+                        auto factor = diagonal[i] / lower[i];
+                        diagonal[i] = lower[i];
+                        lower[i] = factor;
+                        auto t = upper[i];
+                        upper[i] = diagonal[i + 1];
+                        diagonal[i + 1] = t - factor * diagonal[i + 1];
+                        if (i + 2 < n)
+                        {
+                                upper2[i] = upper[i + 1];
+                                upper[i + 1] *= -factor;
+                        }
+                }
+                if (diagonal[n - 1] == 0)
+                        diagonal[n - 1] = tiny;
+
+                auto & x = result[*it];
+                x.resize(n);
+                for (auto & component : x)
+                        component = distribution(generator);
+                for (auto iteration = 0; iteration < INVERSE_ITERATIONS;
+                        iteration++)
+                {
+                        // Solve L U y = x in place
+                        for (std::size_t i = 0; i + 1 < n; i++)
+                        {
+                                if (swapped[i])
+                                        std::swap(x[i], x[i + 1]);
+                                x[i + 1] -= lower[i] * x[i];
+                        }
+                        for (auto i = n; i-- > 0;)
+                        {
+                                if (i + 1 < n)
+                                        x[i] -= upper[i] * x[i + 1];
+                                if (i + 2 < n)
+                                        x[i] -= upper2[i] * x[i + 2];
+                                x[i] /= diagonal[i];
+                        }
+
+                        // Orthogonalize within the cluster, then normalize
+                        for (auto jt = first; jt != it; ++jt)
+                        {
+                                const auto & y = result[*jt];
+                                auto dot = std::inner_product(
+                                        x.begin(), x.end(), y.begin(), 0.0);
+                                for (std::size_t i = 0; i < n; i++)
+                                        x[i] -= dot * y[i];
+                        }
+                        auto length = std::sqrt(std::inner_product(
+                                x.begin(), x.end(), x.begin(), 0.0));
+                        if (length > 0)
+                        {
+                                for (auto & component : x)
+                                        component /= length;
+                        }
+                }
+        }
+        return result;
+}
+
+// Eigenvector of A from eigenvector z of S: x = Q D z
+std::vector<Complex> transform_back(
+        const Tridiagonal & tridiagonal,
+        const double * z)
+{
+        auto n = tridiagonal.diagonal.size();
+        std::vector<Complex> x(n);
+        for (std::size_t i = 0; i < n; i++)
+                x[i] = tridiagonal.phases[i] * z[i];
+        for (auto k = tridiagonal.reflectors.size(); k-- > 0;)
+        {
+                const auto & u = tridiagonal.reflectors[k];
+                auto * y = x.data() + k + 1;
+                Complex dot;
+                for (std::size_t r = 0; r < u.size(); r++)
+                        dot += multiply_conj(y[r], u[r]);
+                for (std::size_t r = 0; r < u.size(); r++)
+                        y[r] -= multiply(u[r], dot);
+        }
+        return x;
+}
+}
+
+namespace Qsa
+{
+Eigensolver::Eigensolver()
+:
+        count_(0)
+{
+}
+
+Eigensolver::Eigensolver(std::size_t count)
+:
+        count_(count)
+{
+}
+
+std::size_t Eigensolver::count() const
+{
+        return count_;
+}
+
+Eigensolver::Eigenpairs Eigensolver::solve(
+        const std::vector<std::complex<double>> & matrix,
+        std::size_t size) const
+{
+        Eigenpairs result;
+        result.size_ = size;
+        if (size == 0 || matrix.size() < size * size)
+                return result;
+
+        auto tridiagonal = reduce(matrix.data(), size);
+        auto count = count_ == 0 ? size : std::min(count_, size);
+        auto values = tridiagonal.diagonal;
+        auto e = tridiagonal.offdiagonal;
+        std::vector<double> vectors; // of the tridiagonal matrix, by rows
+        if (count == size)
+        {
+                vectors.resize(size * size);
+                for (std::size_t i = 0; i < size; i++)
+                        vectors[i * size + i] = 1;
+                diagonalize(values, e, &vectors);
+        }
+        else
+                diagonalize(values, e, nullptr);
+
+        // Leading eigenvalues by magnitude
+        std::vector<std::size_t> order(size);
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&](auto i, auto j)
+        {
+                return std::abs(values[i]) > std::abs(values[j]);
+        });
+        order.resize(count);
+        for (auto i : order)
+                result.values_.push_back(values[i]);
+
+        if (count < size)
+        {
+                auto selected = inverse_iteration(
+                        tridiagonal.diagonal,
+                        tridiagonal.offdiagonal,
+                        result.values_);
+                vectors.clear();
+                for (const auto & vector : selected)
+                        vectors.insert(
+                                vectors.end(),
+                                vector.begin(),
+                                vector.end());
+                std::iota(order.begin(), order.end(), 0);
+        }
+        result.vectors_.reserve(count * size);
+        for (auto i : order)
+        {
+                auto x = transform_back(tridiagonal, &vectors[i * size]);
+                result.vectors_.insert(
+                        result.vectors_.end(),
+                        x.begin(),
+                        x.end());
+        }
+        return result;
+}
+
+std::vector<Eigensolver::Eigenpairs> Eigensolver::solve(
+        const std::vector<std::vector<std::complex<double>>> & batch,
+        std::size_t size) const
+{
+        std::vector<Eigenpairs> result(batch.size());
+        ThreadPool pool;
+        pool.parallel_for(batch.size(), [&](std::size_t i)
+        {
+                result[i] = solve(batch[i], size);
+        });
+        return result;
+}
+
+std::vector<Eigensolver::Eigenpairs> Eigensolver::solve(
+        const std::vector<Analysis::Kernels> & batch) const
+{
+        std::vector<Eigenpairs> result(batch.size());
+        ThreadPool pool;
+        pool.parallel_for(batch.size(), [&](std::size_t i)
+        {
+                result[i] = solve(batch[i].quadratic_, batch[i].size_);
+        });
+        return result;
+}
+}
@@ -0,0 +1,72 @@
+/*
+ * Quadratic Sinusoidal Analysis.
+ * Copyright (C) 2018 OpenQSA.
+ * 
+ * This file is part of OpenQSA.
+ * 
+ * OpenQSA is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ * 
+ * OpenQSA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with OpenQSA.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef QSA_EIGENSOLVER_H
+#define QSA_EIGENSOLVER_H
+
+#include "analysis.h"
+
+#include <complex>
+#include <cstddef>
+#include <vector>
+
+namespace Qsa
+{
+// Eigendecomposition of Hermitian matrices such as the QSA quadratic kernel.
+// Each matrix is reduced to a real symmetric tridiagonal one by Householder
+// reflections and a diagonal phase scaling, then diagonalized by implicit QL.
+// When only the leading eigenpairs are requested, their vectors come from
+// inverse iteration on the tridiagonal matrix and only those are transformed
+// back. Batches are solved in parallel, one matrix per thread at a time.
+class Eigensolver
+{
+public:
+        // Eigenvalues by decreasing magnitude, eigenvector j being stored in
+        // vectors_[j * size_] .. vectors_[(j + 1) * size_ - 1]
+        struct Eigenpairs
+        {
+                std::vector<double> values_;
+                std::vector<std::complex<double>> vectors_;
+                std::size_t size_{};
+        };
+
+        Eigensolver();
+        Eigensolver(const Eigensolver &) = default;
+        Eigensolver & operator=(const Eigensolver &) = default;
+        ~Eigensolver() = default;
+
+        explicit Eigensolver(std::size_t count); // 0 for all eigenpairs
+
+        std::size_t count() const;
+        Eigenpairs solve(
+                const std::vector<std::complex<double>> & matrix,
+                std::size_t size) const;
+        std::vector<Eigenpairs> solve(
+                const std::vector<std::vector<std::complex<double>>> & batch,
+                std::size_t size) const;
+        std::vector<Eigenpairs> solve(
+                const std::vector<Analysis::Kernels> & batch) const;
+
+private:
+        std::size_t count_;
+};
+}
+
+#endif /* QSA_EIGENSOLVER_H */
@@ -0,0 +1,427 @@
+/*
+ * Quadratic Sinusoidal Analysis.
+ * Copyright (C) 2018 OpenQSA.
+ * 
+ * This file is part of OpenQSA.
+ * 
+ * OpenQSA is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ * 
+ * OpenQSA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with OpenQSA.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "fft.h"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <mutex>
+
+namespace
+{
+using Complex = std::complex<double>;
+
+// Plain complex product (std::complex one handles infinities, which is slow)
+inline Complex multiply(Complex a, Complex b)
+{
+        return {
+                a.real() * b.real() - a.imag() * b.imag(),
+                a.real() * b.imag() + a.imag() * b.real()};
+}
+
+// exp(-2 i pi numerator / denominator), exact for multiples of pi / 4
+Complex root(std::size_t numerator, std::size_t denominator)
+{
+        auto angle = 2 * M_PI * (numerator % denominator) / denominator;
+        return {cos(angle), -sin(angle)};
+}
+
+// Stockham butterflies of one stage: inputs are x[q + s * (k + r * m)],
+// outputs y[q + s * (p * k + u)], twiddles w[k * (p - 1) + u - 1].
+// The innermost loop runs over contiguous q, which vectorizes.
+
+void radix2(
+        const Complex * x,
+        Complex * y,
+        const Complex * w,
+        std::size_t m,
+        std::size_t s)
+{
+        for (std::size_t k = 0; k < m; k++)
+        {
+                auto w1 = w[k];
+                auto x0 = x + s * k;
+                auto x1 = x + s * (k + m);
+                auto y0 = y + s * 2 * k;
+                auto y1 = y0 + s;
+                for (std::size_t q = 0; q < s; q++)
+                {
+                        auto a0 = x0[q];
+                        auto a1 = x1[q];
+                        y0[q] = a0 + a1;
+                        y1[q] = multiply(a0 - a1, w1);
+                }
+        }
+}
+
+void radix3(
+        const Complex * x,
+        Complex * y,
+        const Complex * w,
+        std::size_t m,
+        std::size_t s)
+{
+        const double sine = sqrt(3.0) / 2;
+        for (std::size_t k = 0; k < m; k++)
+        {
+                auto w1 = w[2 * k];
+                auto w2 = w[2 * k + 1];
+                auto x0 = x + s * k;
+                auto x1 = x + s * (k + m);
+                auto x2 = x + s * (k + 2 * m);
+                auto y0 = y + s * 3 * k;
+                auto y1 = y0 + s;
+                auto y2 = y1 + s;
+                for (std::size_t q = 0; q < s; q++)
+                {
+                        auto a0 = x0[q];
+                        auto t1 = x1[q] + x2[q];
+                        auto t2 = a0 - 0.5 * t1;
+                        auto d = x1[q] - x2[q];
+                        Complex t3{sine * d.imag(), -sine * d.real()};
+                        y0[q] = a0 + t1;
+                        y1[q] = multiply(t2 + t3, w1);
+                        y2[q] = multiply(t2 - t3, w2);
+                }
+        }
+}
+
+void radix4(
+        const Complex * x,
+        Complex * y,
+        const Complex * w,
+        std::size_t m,
+        std::size_t s)
+{
+        for (std::size_t k = 0; k < m; k++)
+        {
+                auto w1 = w[3 * k];
+                auto w2 = w[3 * k + 1];
+                auto w3 = w[3 * k + 2];
+                auto x0 = x + s * k;
+                auto x1 = x + s * (k + m);
+                auto x2 = x + s * (k + 2 * m);
+                auto x3 = x + s * (k + 3 * m);
+                auto y0 = y + s * 4 * k;
+                auto y1 = y0 + s;
+                auto y2 = y1 + s;
+                auto y3 = y2 + s;
+                for (std::size_t q = 0; q < s; q++)
+                {
+                        auto t0 = x0[q] + x2[q];
+                        auto t1 = x0[q] - x2[q];
+                        auto t2 = x1[q] + x3[q];
+                        auto d = x1[q] - x3[q];
+                        Complex t3{d.imag(), -d.real()}; // -i d
+                        y0[q] = t0 + t2;
+                        y1[q] = multiply(t1 + t3, w1);
+                        y2[q] = multiply(t0 - t2, w2);
+                        y3[q] = multiply(t1 - t3, w3);
+                }
+        }
+}
+
+void radix5(
+        const Complex * x,
+        Complex * y,
+        const Complex * w,
+        std::size_t m,
+        std::size_t s,
+        const Complex * roots)
+{
+        for (std::size_t k = 0; k < m; k++)
+        {
+                for (std::size_t q = 0; q < s; q++)
+                {
+                        Complex a[5];
+                        for (std::size_t r = 0; r < 5; r++)
+                                a[r] = x[q + s * (k + r * m)];
+                        for (std::size_t u = 0; u < 5; u++)
+                        {
+                                auto b = a[0];
+                                for (std::size_t r = 1; r < 5; r++)
+                                        b += multiply(a[r], roots[r * u % 5]);
+                                if (u > 0)
+                                        b = multiply(b, w[k * 4 + u - 1]);
+                                y[q + s * (5 * k + u)] = b;
+                        }
+                }
+        }
+}
+}
+
+namespace Qsa
+{
+struct Fft::Plan
+{
+        struct Stage
+        {
+                std::size_t radix_;
+                std::vector<Complex> twiddles_;
+        };
+
+        std::size_t size_{};
+
+        // Mixed-radix transform, when size is made of factors 2, 3 and 5
+        std::vector<Stage> stages_;
+        Complex roots5_[5];
+
+        // Bluestein transform otherwise, through a power of two convolution
+        std::vector<Complex> chirp_;
+        std::vector<Complex> kernel_;
+        std::shared_ptr<const Plan> convolution_;
+
+        // Split of real transforms of even size through a half-size transform
+        std::vector<Complex> real_twiddles_;
+};
+
+Fft::Fft(std::size_t size)
+:
+        plan_(plan(size))
+{
+        if (size % 2 == 0 && size > 0)
+                half_plan_ = plan(size / 2);
+}
+
+void Fft::forward(std::complex<double> * data) const
+{
+        transform(*plan_, data);
+}
+
+void Fft::forward_real(const double * input, std::complex<double> * output)
+        const
+{
+        auto n = plan_->size_;
+        if (!half_plan_)
+        {
+                // Odd size, plain complex transform
+                std::vector<Complex> data(input, input + n);
+                transform(*plan_, data.data());
+                std::copy_n(data.begin(), n / 2 + 1, output);
+                return;
+        }
+
+        // Transform even and odd samples at once, as real and imaginary parts
+        auto h = n / 2;
+        std::vector<Complex> z(h);
+        for (std::size_t k = 0; k < h; k++)
+                z[k] = {input[2 * k], input[2 * k + 1]};
+        transform(*half_plan_, z.data());
+        for (std::size_t k = 0; k <= h; k++)
+        {
+                auto zk = z[k % h];
+                auto zc = std::conj(z[(h - k) % h]);
+                auto even = 0.5 * (zk + zc);
+                auto odd = 0.5 * (zk - zc);
+                odd = {odd.imag(), -odd.real()}; // divided by i
+                output[k] = even + multiply(plan_->real_twiddles_[k], odd);
+        }
+}
+
+void Fft::inverse(std::complex<double> * data) const
+{
+        auto n = plan_->size_;
+        for (std::size_t i = 0; i < n; i++)
+                data[i] = std::conj(data[i]);
+        transform(*plan_, data);
+        for (std::size_t i = 0; i < n; i++)
+                data[i] = std::conj(data[i]);
+}
+
+void Fft::inverse_real(const std::complex<double> * input, double * output)
+        const
+{
+        auto n = plan_->size_;
+        if (!half_plan_)
+        {
+                // Odd size, rebuild the full hermitian spectrum
+                std::vector<Complex> data(n);
+                for (std::size_t k = 0; k <= n / 2; k++)
+                {
+                        data[k] = input[k];
+                        if (k > 0)
+                                data[n - k] = std::conj(input[k]);
+                }
+                inverse(data.data());
+                for (std::size_t i = 0; i < n; i++)
+                        output[i] = data[i].real();
+                return;
+        }
+
+        // Merge back even and odd spectra, then a single half-size transform
+        auto h = n / 2;
+        std::vector<Complex> z(h);
+        for (std::size_t k = 0; k < h; k++)
+        {
+                auto xk = input[k];
+                auto xc = std::conj(input[h - k]);
+                auto even = 0.5 * (xk + xc);
+                auto odd = multiply(
+                        0.5 * (xk - xc),
+                        std::conj(plan_->real_twiddles_[k]));
+                z[k] = even + Complex{-odd.imag(), odd.real()};
+        }
+        for (auto & value : z)
+                value = std::conj(value);
+        transform(*half_plan_, z.data());
+        for (std::size_t k = 0; k < h; k++)
+        {
+                output[2 * k] = 2 * z[k].real();
+                output[2 * k + 1] = -2 * z[k].imag();
+        }
+}
+
+std::size_t Fft::size() const
+{
+        return plan_ ? plan_->size_ : 0;
+}
+
+std::shared_ptr<const Fft::Plan> Fft::plan(std::size_t size)
+{
+        static std::mutex mutex;
+        static std::map<std::size_t, std::shared_ptr<const Plan>> cache;
+        {
+                std::lock_guard<std::mutex> lock(mutex);
+                auto it = cache.find(size);
+                if (it != cache.end())
+                        return it->second;
+        }
+
+        auto result = std::make_shared<Plan>();
+        result->size_ = size;
+        for (std::size_t u = 0; u < 5; u++)
+                result->roots5_[u] = root(u, 5);
+        for (std::size_t k = 0; k <= size / 2; k++)
+                result->real_twiddles_.push_back(root(k, size));
+
+        // Factorize size, largest radix first
+        auto rest = size;
+        std::vector<std::size_t> radices;
+        for (std::size_t radix : {4, 2, 3, 5})
+        {
+                while (rest > 1 && rest % radix == 0)
+                {
+                        radices.push_back(radix);
+                        rest /= radix;
+                }
+        }
+        if (rest == 1)
+        {
+                auto length = size;
+                for (auto radix : radices)
+                {
+                        Plan::Stage stage;
+                        stage.radix_ = radix;
+                        auto m = length / radix;
+                        for (std::size_t k = 0; k < m; k++)
+                        {
+                                for (std::size_t u = 1; u < radix; u++)
+                                        stage.twiddles_.push_back(
+                                                root(u * k, length));
+                        }
+                        result->stages_.push_back(std::move(stage));
+                        length = m;
+                }
+        }
+        else
+        {
+                // Bluestein: chirp exp(-i pi j^2 / n), j^2 taken modulo 2 n
+                std::size_t m = 1;
+                while (m < 2 * size - 1)
+                        m *= 2;
+                result->convolution_ = plan(m);
+                for (std::size_t j = 0; j < size; j++)
+                {
+                        result->chirp_.push_back(
+                                root(j * j % (2 * size), 2 * size));
+                }
+                result->kernel_.assign(m, Complex{});
+                result->kernel_[0] = 1;
+                for (std::size_t j = 1; j < size; j++)
+                {
+                        result->kernel_[j] = std::conj(result->chirp_[j]);
+                        result->kernel_[m - j] = std::conj(result->chirp_[j]);
+                }
+                transform(*result->convolution_, result->kernel_.data());
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        return cache.emplace(size, result).first->second;
+}
+
+void Fft::transform(const Plan & plan, std::complex<double> * data)
+{
+        auto n = plan.size_;
+        if (n <= 1)
+                return;
+
+        if (plan.convolution_)
+        {
+                // Bluestein: chirp, convolve with the chirp kernel, chirp again
+                auto m = plan.convolution_->size_;
+                std::vector<Complex> a(m);
+                for (std::size_t j = 0; j < n; j++)
+                        a[j] = multiply(data[j], plan.chirp_[j]);
+                transform(*plan.convolution_, a.data());
+                for (std::size_t j = 0; j < m; j++)
+                        a[j] = std::conj(multiply(a[j], plan.kernel_[j]));
+                transform(*plan.convolution_, a.data());
+                for (std::size_t k = 0; k < n; k++)
+                {
+                        data[k] = multiply(std::conj(a[k]), plan.chirp_[k]);
+                        data[k] /= double(m);
+                }
+                return;
+        }
+
+        // Stockham autosort: ping-pong between data and a work buffer
+        std::vector<Complex> work(n);
+        auto x = data;
+        auto y = work.data();
+        std::size_t s = 1;
+        auto length = n;
+        for (const auto & stage : plan.stages_)
+        {
+                auto m = length / stage.radix_;
+                auto w = stage.twiddles_.data();
+                switch (stage.radix_)
+                {
+                case 2:
+                        radix2(x, y, w, m, s);
+                        break;
+                case 3:
+                        radix3(x, y, w, m, s);
+                        break;
+                case 4:
+                        radix4(x, y, w, m, s);
+                        break;
+                default:
+                        radix5(x, y, w, m, s, plan.roots5_);
+                        break;
+                }
+                std::swap(x, y);
+                length = m;
+                s *= stage.radix_;
+        }
+        if (x != data)
+                std::copy_n(x, n, data);
+}
+}
@@ -0,0 +1,64 @@
+/*
+ * Quadratic Sinusoidal Analysis.
+ * Copyright (C) 2018 OpenQSA.
+ * 
+ * This file is part of OpenQSA.
+ * 
+ * OpenQSA is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ * 
+ * OpenQSA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with OpenQSA.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef QSA_FFT_H
+#define QSA_FFT_H
+
+#include <complex>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace Qsa
+{
+// Discrete Fourier transform of any length. Lengths made of factors 2, 3 and 5
+// use a mixed-radix Stockham transform, other lengths use Bluestein's
+// algorithm. Plans are computed once per length and shared between instances.
+// Transforms are not normalized: forward then inverse multiplies by size().
+class Fft
+{
+public:
+        Fft() = default;
+        Fft(const Fft &) = default;
+        Fft & operator=(const Fft &) = default;
+        ~Fft() = default;
+
+        explicit Fft(std::size_t size);
+
+        void forward(std::complex<double> * data) const;
+        void forward_real(const double * input, std::complex<double> * output)
+                const;
+        void inverse(std::complex<double> * data) const;
+        void inverse_real(const std::complex<double> * input, double * output)
+                const;
+        std::size_t size() const;
+
+private:
+        struct Plan;
+
+        static std::shared_ptr<const Plan> plan(std::size_t size);
+        static void transform(const Plan & plan, std::complex<double> * data);
+
+        std::shared_ptr<const Plan> plan_;
+        std::shared_ptr<const Plan> half_plan_;
+};
+}
+
+#endif /* QSA_FFT_H */
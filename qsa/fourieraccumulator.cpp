@@ -0,0 +1,172 @@
+/*
+ * Quadratic Sinusoidal Analysis.
+ * Copyright (C) 2018 OpenQSA.
+ * 
+ * This file is part of OpenQSA.
+ * 
+ * OpenQSA is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ * 
+ * OpenQSA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with OpenQSA.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "fourieraccumulator.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+// Phasors are recomputed exactly at this interval to stop rounding drift
+const std::size_t SYNCHRONIZATION_INTERVAL = 1024;
+}
+
+namespace Qsa
+{
+FourierAccumulator::FourierAccumulator()
+:
+        period_(0),
+        count_(0),
+        phase_(0)
+{
+}
+
+FourierAccumulator::FourierAccumulator(
+        const std::vector<int> & bins,
+        std::size_t period)
+:
+        bins_(bins),
+        period_(period),
+        count_(0),
+        phase_(0),
+        rotation_re_(bins.size()),
+        rotation_im_(bins.size()),
+        phasor_re_(bins.size()),
+        phasor_im_(bins.size()),
+        stimulation_re_(bins.size()),
+        stimulation_im_(bins.size()),
+        response_re_(bins.size()),
+        response_im_(bins.size())
+{
+        for (std::size_t b = 0; b < bins_.size(); b++)
+        {
+                auto angle = 2 * M_PI * bins_[b] / period_;
+                rotation_re_[b] = cos(angle);
+                rotation_im_[b] = -sin(angle);
+        }
+        reset();
+}
+
+const std::vector<int> & FourierAccumulator::bins() const
+{
+        return bins_;
+}
+
+bool FourierAccumulator::complete() const
+{
+        return period_ > 0 && count_ == period_;
+}
+
+std::size_t FourierAccumulator::count() const
+{
+        return count_;
+}
+
+std::size_t FourierAccumulator::period() const
+{
+        return period_;
+}
+
+void FourierAccumulator::push(
+        const double * stimulation,
+        const double * response,
+        std::size_t count)
+{
+        auto n = bins_.size();
+        auto sr = stimulation_re_.data();
+        auto si = stimulation_im_.data();
+        auto rr = response_re_.data();
+        auto ri = response_im_.data();
+        auto pr = phasor_re_.data();
+        auto pi = phasor_im_.data();
+        auto wr = rotation_re_.data();
+        auto wi = rotation_im_.data();
+        count = std::min(count, period_ - count_);
+        for (std::size_t i = 0; i < count; i++)
+        {
+                // Samples beyond one period are ignored
+                auto x = stimulation[i];
+                auto y = response[i];
+                for (std::size_t b = 0; b < n; b++)
+                {
+                        sr[b] += x * pr[b];
+                        si[b] += x * pi[b];
+                        rr[b] += y * pr[b];
+                        ri[b] += y * pi[b];
+                        auto re = pr[b] * wr[b] - pi[b] * wi[b];
+                        auto im = pr[b] * wi[b] + pi[b] * wr[b];
+                        pr[b] = re;
+                        pi[b] = im;
+                }
+                count_++;
+                if (count_ % SYNCHRONIZATION_INTERVAL == 0)
+                        synchronize();
+        }
+}
+
+void FourierAccumulator::reset(std::size_t phase)
+{
+        count_ = 0;
+        phase_ = period_ > 0 ? phase % period_ : 0;
+        std::fill(stimulation_re_.begin(), stimulation_re_.end(), 0.0);
+        std::fill(stimulation_im_.begin(), stimulation_im_.end(), 0.0);
+        std::fill(response_re_.begin(), response_re_.end(), 0.0);
+        std::fill(response_im_.begin(), response_im_.end(), 0.0);
+        synchronize();
+}
+
+std::vector<std::complex<double>> FourierAccumulator::response() const
+{
+        std::vector<std::complex<double>> result(bins_.size());
+        for (std::size_t b = 0; b < bins_.size(); b++)
+        {
+                result[b] = {
+                        response_re_[b] / period_,
+                        response_im_[b] / period_};
+        }
+        return result;
+}
+
+std::vector<std::complex<double>> FourierAccumulator::stimulation() const
+{
+        std::vector<std::complex<double>> result(bins_.size());
+        for (std::size_t b = 0; b < bins_.size(); b++)
+        {
+                result[b] = {
+                        stimulation_re_[b] / period_,
+                        stimulation_im_[b] / period_};
+        }
+        return result;
+}
+
+void FourierAccumulator::synchronize()
+{
+        for (std::size_t b = 0; b < bins_.size(); b++)
+        {
+                // Exact phase of the next sample, reduced modulo the period
+                auto k = static_cast<long long>(bins_[b]) % period_;
+                auto n = static_cast<long long>(count_ + phase_);
+                auto angle = 2 * M_PI * ((k * n) % period_) / period_;
+                phasor_re_[b] = cos(angle);
+                phasor_im_[b] = -sin(angle);
+        }
+}
+}
@@ -0,0 +1,80 @@
+/*
+ * Quadratic Sinusoidal Analysis.
+ * Copyright (C) 2018 OpenQSA.
+ * 
+ * This file is part of OpenQSA.
+ * 
+ * OpenQSA is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ * 
+ * OpenQSA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with OpenQSA.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef QSA_FOURIERACCUMULATOR_H
+#define QSA_FOURIERACCUMULATOR_H
+
+#include <complex>
+#include <cstddef>
+#include <vector>
+
+namespace Qsa
+{
+// Projects a periodic signal onto a few frequency bins sample by sample,
+// so that Fourier coefficients are known as soon as a period is recorded.
+// A coefficient c of bin k is such that the signal holds c exp(2 i pi k n / N)
+// plus its conjugate, where N is the period in samples.
+class FourierAccumulator
+{
+public:
+        FourierAccumulator();
+        FourierAccumulator(const FourierAccumulator &) = default;
+        FourierAccumulator & operator=(const FourierAccumulator &) = default;
+        ~FourierAccumulator() = default;
+
+        explicit FourierAccumulator(
+                const std::vector<int> & bins,
+                std::size_t period);
+
+        const std::vector<int> & bins() const;
+        bool complete() const;
+        std::size_t count() const;
+        std::size_t period() const;
+        void push(
+                const double * stimulation,
+                const double * response,
+                std::size_t count);
+        // Next samples pushed start at the given phase of the period, in
+        // samples, coefficients being still those of the period from phase 0
+        void reset(std::size_t phase = 0);
+        std::vector<std::complex<double>> response() const;
+        std::vector<std::complex<double>> stimulation() const;
+
+private:
+        void synchronize();
+
+        std::vector<int> bins_;
+        std::size_t period_;
+        std::size_t count_;
+        std::size_t phase_;
+
+        // Phasor bank, one lane per bin, real and imaginary parts split
+        std::vector<double> rotation_re_;
+        std::vector<double> rotation_im_;
+        std::vector<double> phasor_re_;
+        std::vector<double> phasor_im_;
+        std::vector<double> stimulation_re_;
+        std::vector<double> stimulation_im_;
+        std::vector<double> response_re_;
+        std::vector<double> response_im_;
+};
+}
+
+#endif /* QSA_FOURIERACCUMULATOR_H */
@@ -23,6 +23,12 @@
 #include <algorithm>
 #include <random>
 
+namespace
+{
+// Candidates tried between progress reports
+const std::size_t PROGRESS_STEP = 64;
+}
+
 namespace Qsa
 {
 std::set<int> mix(const std::set<int> & generators, int k)
@@ -70,13 +76,64 @@ std::vector<int> random_range(int a, int b, int seed = 0)
         return source;
 }
 
-Intermodulation Intermodulation::make(const std::vector<int> & source)
+Intermodulation Intermodulation::from_generators(
+        const std::vector<int> & generators)
+{
+        if (generators.empty())
+                return {};
+        auto maximum = *std::max_element(generators.begin(), generators.end());
+        auto minimum = *std::min_element(generators.begin(), generators.end());
+        if (minimum <= 0)
+                return make(generators);
+
+        // Mark every product, as make() would mix them, any product reached
+        // twice meaning that generators do not come from make()
+        std::vector<char> marks(2 * static_cast<std::size_t>(maximum) + 1);
+        auto mark = [&](int product)
+        {
+                auto & seen = marks[product];
+                auto collision = seen != 0;
+                seen = 1;
+                return collision;
+        };
+        for (std::size_t i = 0; i < generators.size(); i++)
+        {
+                auto k = generators[i];
+                if (mark(k) || mark(2 * k))
+                        return make(generators);
+                for (std::size_t j = 0; j < i; j++)
+                {
+                        auto g = generators[j];
+                        if (mark(k + g) || mark(std::abs(k - g)))
+                                return make(generators);
+                }
+        }
+
+        // Sorted insertions at the end take constant time
+        std::set<int> products;
+        for (std::size_t product = 0; product < marks.size(); product++)
+        {
+                if (marks[product])
+                        products.insert(products.end(), product);
+        }
+        return Intermodulation(
+                std::set<int>(generators.begin(), generators.end()),
+                products);
+}
+
+Intermodulation Intermodulation::make(
+        const std::vector<int> & source,
+        const Progress & progress)
 {
         // Compute generators and products from a given source
         std::set<int> generators;
         std::set<int> products;
-        for (auto k : source)
+        for (std::size_t i = 0; i < source.size(); i++)
         {
+                if (progress && i % PROGRESS_STEP == 0 &&
+                        !progress(double(i) / source.size()))
+                        return {};
+                auto k = source[i];
                 // Compute quadratic frequency mixing without overlapping
                 std::set<int> mixing = mix(generators, k);
                 if (mixing.empty())
@@ -91,10 +148,49 @@ Intermodulation Intermodulation::make(const std::vector<int> & source)
         return Intermodulation(generators, products);
 }
 
-Intermodulation Intermodulation::make(int a, int b, int seed)
+Intermodulation Intermodulation::make(
+        int a,
+        int b,
+        int seed,
+        const Progress & progress)
 {
         // Generate intermodulation from random source between [a .. b]
-        return make(random_range(a, b, seed));
+        return make(random_range(a, b, seed), progress);
+}
+
+std::vector<Intermodulation> Intermodulation::make_channels(
+        int count,
+        int a,
+        int b,
+        int seed,
+        const Progress & progress)
+{
+        if (count < 1)
+                return {};
+
+        // Plan all channels jointly, then deal generators out in turn so
+        // that every channel spans the whole frequency range
+        auto cancelled = false;
+        Progress report;
+        if (progress)
+        {
+                report = [&](double fraction)
+                {
+                        cancelled = !progress(fraction);
+                        return !cancelled;
+                };
+        }
+        auto joint = make(a, b, seed, report);
+        if (cancelled)
+                return {};
+        std::vector<std::vector<int>> generators(count);
+        auto k = 0;
+        for (auto generator : joint.generators())
+                generators[k++ % count].push_back(generator);
+        std::vector<Intermodulation> result;
+        for (const auto & channel : generators)
+                result.push_back(from_generators(channel));
+        return result;
 }
 
 const std::set<int> & Intermodulation::generators() const
@@ -21,6 +21,7 @@
 #ifndef QSA_INTERMODULATION_H
 #define QSA_INTERMODULATION_H
 
+#include <functional>
 #include <set>
 #include <vector>
 
@@ -29,13 +30,36 @@ namespace Qsa
 class Intermodulation
 {
 public:
+        // Called with the fraction of the source searched, returns false to
+        // abort, leaving the result empty
+        using Progress = std::function<bool(double)>;
+
         Intermodulation() = default;
         Intermodulation(const Intermodulation &) = default;
         Intermodulation & operator=(const Intermodulation &) = default;
         ~Intermodulation() = default;
 
-        static Intermodulation make(const std::vector<int> & source);
-        static Intermodulation make(int a, int b, int seed = 0);
+        // Generators of a previous make(), in any order: products are
+        // expanded in time linear in their number, falling back to make()
+        // if they turn out to collide
+        static Intermodulation from_generators(
+                const std::vector<int> & generators);
+        static Intermodulation make(
+                const std::vector<int> & source,
+                const Progress & progress = {});
+        static Intermodulation make(
+                int a,
+                int b,
+                int seed = 0,
+                const Progress & progress = {});
+        // Generators of one make() dealt out to count channels: products
+        // between channels collide with no generator or product either
+        static std::vector<Intermodulation> make_channels(
+                int count,
+                int a,
+                int b,
+                int seed = 0,
+                const Progress & progress = {});
 
         const std::set<int> & generators() const;
         const std::set<int> & products() const;
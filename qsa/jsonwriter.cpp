@@ -0,0 +1,282 @@
+/*
+ * Quadratic Sinusoidal Analysis.
+ * Copyright (C) 2018 OpenQSA.
+ * 
+ * This file is part of OpenQSA.
+ * 
+ * OpenQSA is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ * 
+ * OpenQSA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with OpenQSA.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "jsonwriter.h"
+
+#include <charconv>
+#include <cmath>
+#include <cstdlib>
+#include <string_view>
+
+namespace
+{
+// Output is handed to the stream by blocks of this size
+const std::size_t BUFFER_SIZE = 1 << 16;
+}
+
+namespace Qsa
+{
+JsonWriter::JsonWriter()
+:
+        stream_(nullptr),
+        after_key_(false)
+{
+}
+
+JsonWriter::JsonWriter(std::ostream & stream)
+:
+        stream_(&stream),
+        after_key_(false)
+{
+        buffer_.reserve(BUFFER_SIZE);
+}
+
+JsonWriter::~JsonWriter()
+{
+        flush();
+}
+
+JsonWriter & JsonWriter::begin_array()
+{
+        separate();
+        buffer_ += '[';
+        first_.push_back(true);
+        return *this;
+}
+
+JsonWriter & JsonWriter::begin_object()
+{
+        separate();
+        buffer_ += '{';
+        first_.push_back(true);
+        return *this;
+}
+
+JsonWriter & JsonWriter::end_array()
+{
+        buffer_ += ']';
+        first_.pop_back();
+        return *this;
+}
+
+JsonWriter & JsonWriter::end_object()
+{
+        buffer_ += '}';
+        first_.pop_back();
+        return *this;
+}
+
+void JsonWriter::flush()
+{
+        if (stream_ == nullptr)
+                return;
+        stream_->write(buffer_.data(), buffer_.size());
+        buffer_.clear();
+}
+
+JsonWriter & JsonWriter::key(const std::string & name)
+{
+        value(name);
+        buffer_ += ':';
+        after_key_ = true;
+        return *this;
+}
+
+JsonWriter & JsonWriter::raw(const std::string & json)
+{
+        separate();
+        if (stream_ != nullptr && buffer_.size() + json.size() > BUFFER_SIZE)
+        {
+                // Large fragments bypass the buffer
+                flush();
+                stream_->write(json.data(), json.size());
+        }
+        else
+                buffer_ += json;
+        return *this;
+}
+
+std::string JsonWriter::release()
+{
+        std::string result;
+        result.swap(buffer_);
+        return result;
+}
+
+JsonWriter & JsonWriter::value(double number)
+{
+        separate();
+        append_double(number);
+        return *this;
+}
+
+JsonWriter & JsonWriter::value(int number)
+{
+        separate();
+        buffer_ += std::to_string(number);
+        return *this;
+}
+
+JsonWriter & JsonWriter::value(const std::string & text)
+{
+        separate();
+        buffer_ += '"';
+        for (auto c : text)
+        {
+                switch (c)
+                {
+                case '"':
+                        buffer_ += "\\\"";
+                        break;
+                case '\\':
+                        buffer_ += "\\\\";
+                        break;
+                case '\n':
+                        buffer_ += "\\n";
+                        break;
+                case '\t':
+                        buffer_ += "\\t";
+                        break;
+                default:
+                        if (static_cast<unsigned char>(c) < 0x20)
+                        {
+                                const char * hex = "0123456789abcdef";
+                                buffer_ += "\\u00";
+                                buffer_ += hex[(c >> 4) & 0xf];
+                                buffer_ += hex[c & 0xf];
+                        }
+                        else
+                                buffer_ += c;
+                }
+        }
+        buffer_ += '"';
+        return *this;
+}
+
+JsonWriter & JsonWriter::value(const std::vector<double> & numbers)
+{
+        begin_array();
+        for (auto number : numbers)
+        {
+                if (!first_.back())
+                        buffer_ += ',';
+                first_.back() = false;
+                append_double(number);
+                if (stream_ != nullptr && buffer_.size() >= BUFFER_SIZE)
+                        flush();
+        }
+        return end_array();
+}
+
+JsonWriter & JsonWriter::value(const std::vector<int> & numbers)
+{
+        begin_array();
+        for (auto number : numbers)
+                value(number);
+        return end_array();
+}
+
+void JsonWriter::append_double(double number)
+{
+        if (!std::isfinite(number))
+        {
+                // Same convention as nlohmann::json
+                buffer_ += "null";
+                return;
+        }
+
+        // Shortest round-trip digits, as d.ddde[+-]xx
+        char scientific[32];
+        auto result = std::to_chars(
+                scientific,
+                scientific + sizeof(scientific),
+                number,
+                std::chars_format::scientific);
+        std::string_view text(scientific, result.ptr - scientific);
+        if (text.front() == '-')
+        {
+                buffer_ += '-';
+                text.remove_prefix(1);
+        }
+        auto e = text.find('e');
+        auto exponent = 0;
+        auto sign = text[e + 1] == '-' ? -1 : 1;
+        std::from_chars(
+                text.data() + e + 2,
+                text.data() + text.size(),
+                exponent);
+        exponent *= sign;
+        char digits[24];
+        auto k = 0;
+        for (auto c : text.substr(0, e))
+        {
+                if (c != '.')
+                        digits[k++] = c;
+        }
+
+        // Lay out digits like nlohmann::json (fixed for 1e-4 <= |x| < 1e15)
+        auto n = exponent + 1;
+        if (k <= n && n <= 15)
+        {
+                buffer_.append(digits, k);
+                buffer_.append(n - k, '0');
+                buffer_ += ".0";
+        }
+        else if (0 < n && n <= 15)
+        {
+                buffer_.append(digits, n);
+                buffer_ += '.';
+                buffer_.append(digits + n, k - n);
+        }
+        else if (-4 < n && n <= 0)
+        {
+                buffer_ += "0.";
+                buffer_.append(-n, '0');
+                buffer_.append(digits, k);
+        }
+        else
+        {
+                buffer_ += digits[0];
+                if (k > 1)
+                {
+                        buffer_ += '.';
+                        buffer_.append(digits + 1, k - 1);
+                }
+                buffer_ += 'e';
+                buffer_ += exponent < 0 ? '-' : '+';
+                auto magnitude = std::abs(exponent);
+                if (magnitude < 10)
+                        buffer_ += '0';
+                buffer_ += std::to_string(magnitude);
+        }
+}
+
+void JsonWriter::separate()
+{
+        if (after_key_)
+                after_key_ = false;
+        else if (!first_.empty())
+        {
+                if (!first_.back())
+                        buffer_ += ',';
+                first_.back() = false;
+        }
+}
+}
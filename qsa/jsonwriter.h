@@ -0,0 +1,67 @@
+/*
+ * Quadratic Sinusoidal Analysis.
+ * Copyright (C) 2018 OpenQSA.
+ * 
+ * This file is part of OpenQSA.
+ * 
+ * OpenQSA is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ * 
+ * OpenQSA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with OpenQSA.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef QSA_JSONWRITER_H
+#define QSA_JSONWRITER_H
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace Qsa
+{
+// Streaming JSON emitter writing straight to a buffered output, without
+// building a document in memory. Doubles use the shortest representation
+// that round-trips, laid out like nlohmann::json does.
+class JsonWriter
+{
+public:
+        JsonWriter();
+        explicit JsonWriter(std::ostream & stream);
+        JsonWriter(const JsonWriter &) = delete;
+        JsonWriter & operator=(const JsonWriter &) = delete;
+        ~JsonWriter();
+
+        JsonWriter & begin_array();
+        JsonWriter & begin_object();
+        JsonWriter & end_array();
+        JsonWriter & end_object();
+        void flush();
+        JsonWriter & key(const std::string & name);
+        JsonWriter & raw(const std::string & json);
+        std::string release();
+        JsonWriter & value(double number);
+        JsonWriter & value(int number);
+        JsonWriter & value(const std::string & text);
+        JsonWriter & value(const std::vector<double> & numbers);
+        JsonWriter & value(const std::vector<int> & numbers);
+
+private:
+        void append_double(double number);
+        void separate();
+
+        std::ostream * stream_;
+        std::string buffer_;
+        std::vector<bool> first_;
+        bool after_key_;
+};
+}
+
+#endif /* QSA_JSONWRITER_H */
@@ -0,0 +1,104 @@
+/*
+ * Quadratic Sinusoidal Analysis.
+ * Copyright (C) 2018 OpenQSA.
+ * 
+ * This file is part of OpenQSA.
+ * 
+ * OpenQSA is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ * 
+ * OpenQSA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with OpenQSA.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "kernelaverage.h"
+
+#include <cmath>
+
+namespace
+{
+using Complex = std::complex<double>;
+
+// Welford update of means and sums of squared deviations, the squared
+// modulus of a complex deviation being the sum of those of its parts
+void update(
+        std::vector<Complex> & mean,
+        std::vector<double> & deviation,
+        const std::vector<Complex> & value,
+        std::size_t count)
+{
+        for (std::size_t i = 0; i < mean.size(); i++)
+        {
+                auto delta = value[i] - mean[i];
+                mean[i] += delta / double(count);
+                auto residual = value[i] - mean[i];
+                deviation[i] += delta.real() * residual.real() +
+                        delta.imag() * residual.imag();
+        }
+}
+
+// Standard errors of means from sums of squared deviations
+std::vector<double> errors(
+        const std::vector<double> & deviation,
+        std::size_t count)
+{
+        std::vector<double> result(deviation.size());
+        if (count < 2)
+                return result;
+        auto scale = double(count) * (count - 1);
+        for (std::size_t i = 0; i < result.size(); i++)
+                result[i] = std::sqrt(deviation[i] / scale);
+        return result;
+}
+}
+
+namespace Qsa
+{
+KernelAverage::KernelAverage(const Analysis & analysis)
+:
+        mean_(analysis.kernels({})),
+        linear_deviation_(mean_.linear_.size()),
+        quadratic_deviation_(mean_.quadratic_.size())
+{
+}
+
+void KernelAverage::add(const Analysis::Kernels & estimate)
+{
+        // Incomplete traces have no estimate
+        if (estimate.trace_count_ == 0)
+                return;
+        mean_.trace_count_++;
+        update(
+                mean_.linear_,
+                linear_deviation_,
+                estimate.linear_,
+                mean_.trace_count_);
+        update(
+                mean_.quadratic_,
+                quadratic_deviation_,
+                estimate.quadratic_,
+                mean_.trace_count_);
+}
+
+std::size_t KernelAverage::count() const
+{
+        return mean_.trace_count_;
+}
+
+Analysis::Kernels KernelAverage::kernels() const
+{
+        auto result = mean_;
+        result.linear_error_ = errors(linear_deviation_, mean_.trace_count_);
+        result.quadratic_error_ = errors(
+                quadratic_deviation_,
+                mean_.trace_count_);
+        return result;
+}
+}
@@ -0,0 +1,54 @@
+/*
+ * Quadratic Sinusoidal Analysis.
+ * Copyright (C) 2018 OpenQSA.
+ * 
+ * This file is part of OpenQSA.
+ * 
+ * OpenQSA is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ * 
+ * OpenQSA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with OpenQSA.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef QSA_KERNELAVERAGE_H
+#define QSA_KERNELAVERAGE_H
+
+#include "analysis.h"
+
+#include <cstddef>
+#include <vector>
+
+namespace Qsa
+{
+// Running average of per-trace kernel estimates, with the spread of these
+// estimates (Welford's algorithm), so traces can be discarded once added.
+class KernelAverage
+{
+public:
+        KernelAverage() = default;
+        KernelAverage(const KernelAverage &) = default;
+        KernelAverage & operator=(const KernelAverage &) = default;
+        ~KernelAverage() = default;
+
+        explicit KernelAverage(const Analysis & analysis);
+
+        void add(const Analysis::Kernels & estimate);
+        std::size_t count() const;
+        Analysis::Kernels kernels() const;
+
+private:
+        Analysis::Kernels mean_;
+        std::vector<double> linear_deviation_; // sums of squared deviations
+        std::vector<double> quadratic_deviation_;
+};
+}
+
+#endif /* QSA_KERNELAVERAGE_H */
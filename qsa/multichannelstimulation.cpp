@@ -0,0 +1,106 @@
+/*
+ * Quadratic Sinusoidal Analysis.
+ * Copyright (C) 2018 OpenQSA.
+ * 
+ * This file is part of OpenQSA.
+ * 
+ * OpenQSA is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ * 
+ * OpenQSA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with OpenQSA.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "multichannelstimulation.h"
+
+#include <stdexcept>
+
+namespace Qsa
+{
+MultichannelStimulation::MultichannelStimulation(
+        const std::vector<Stimulation> & channels)
+:
+        channels_(channels)
+{
+        if (channels_.empty())
+                throw std::runtime_error("stimulation without channel");
+        for (auto & channel : channels_)
+        {
+                if (!channel.waveform_)
+                        channel.precompute();
+        }
+        auto size = channels_[0].waveform().size();
+        for (const auto & channel : channels_)
+        {
+                if (channel.waveform().size() != size)
+                        throw std::runtime_error(
+                                "stimulation channels differ in timing");
+        }
+}
+
+void MultichannelStimulation::apply()
+{
+        if (!channels_.empty())
+                channels_[0].apply();
+}
+
+const Stimulation & MultichannelStimulation::channel(std::size_t k) const
+{
+        return channels_.at(k);
+}
+
+std::size_t MultichannelStimulation::channel_count() const
+{
+        return channels_.size();
+}
+
+void MultichannelStimulation::evaluate_tick(
+        long tick,
+        double * outputs,
+        int & sync) const
+{
+        auto count = channels_.size();
+        std::size_t index;
+        if (count == 0 || !channels_[0].advance(tick, index, sync))
+        {
+                sync = Stimulation::SYNC_OFF;
+                for (std::size_t k = 0; k < count; k++)
+                        outputs[k] = channels_[k].rest_level();
+                return;
+        }
+        for (std::size_t k = 0; k < count; k++)
+                outputs[k] = channels_[k].waveform_->output[index];
+}
+
+bool MultichannelStimulation::is_applying() const
+{
+        return !channels_.empty() && channels_[0].is_applying();
+}
+
+void MultichannelStimulation::request_stop()
+{
+        if (!channels_.empty())
+                channels_[0].request_stop();
+}
+
+void MultichannelStimulation::resume(
+        const MultichannelStimulation & previous,
+        long tick)
+{
+        if (!channels_.empty() && !previous.channels_.empty())
+                channels_[0].resume(previous.channels_[0], tick);
+}
+
+void MultichannelStimulation::settle()
+{
+        if (!channels_.empty())
+                channels_[0].settle();
+}
+}
@@ -0,0 +1,63 @@
+/*
+ * Quadratic Sinusoidal Analysis.
+ * Copyright (C) 2018 OpenQSA.
+ * 
+ * This file is part of OpenQSA.
+ * 
+ * OpenQSA is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ * 
+ * OpenQSA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with OpenQSA.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef QSA_MULTICHANNELSTIMULATION_H
+#define QSA_MULTICHANNELSTIMULATION_H
+
+#include "stimulation.h"
+
+#include <cstddef>
+#include <vector>
+
+namespace Qsa
+{
+// Stimulations applied at once on several outputs, e.g. one per electrode,
+// all with the same timing. The first channel keeps time for all of them,
+// every channel being read in place from its own, shared, waveform.
+class MultichannelStimulation
+{
+public:
+        MultichannelStimulation() = default;
+        MultichannelStimulation(const MultichannelStimulation &) = default;
+        MultichannelStimulation & operator=(
+                const MultichannelStimulation &) = default;
+        ~MultichannelStimulation() = default;
+
+        explicit MultichannelStimulation(
+                const std::vector<Stimulation> & channels);
+
+        void apply();
+        const Stimulation & channel(std::size_t k) const;
+        std::size_t channel_count() const;
+        // Writes channel_count() outputs
+        void evaluate_tick(long tick, double * outputs, int & sync) const;
+        bool is_applying() const;
+        void request_stop();
+        // Takes over from previous, being applied at tick, e.g. once
+        // resampled, the same point in time being reached on the same tick
+        void resume(const MultichannelStimulation & previous, long tick);
+        void settle();
+
+private:
+        std::vector<Stimulation> channels_;
+};
+}
+
+#endif /* QSA_MULTICHANNELSTIMULATION_H */
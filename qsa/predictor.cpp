@@ -0,0 +1,210 @@
+/*
+ * Quadratic Sinusoidal Analysis.
+ * Copyright (C) 2018 OpenQSA.
+ * 
+ * This file is part of OpenQSA.
+ * 
+ * OpenQSA is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ * 
+ * OpenQSA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with OpenQSA.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "predictor.h"
+
+#include "eigensolver.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+// Transforms are at least this many times longer than filters, so that most
+// of each block is output
+const std::size_t BLOCK_FACTOR = 4;
+}
+
+namespace Qsa
+{
+const std::size_t Predictor::DEFAULT_RANK = 4;
+
+Predictor::Predictor()
+:
+        length_(0)
+{
+}
+
+Predictor::Predictor(
+        const Analysis::Kernels & kernels,
+        double dt,
+        std::size_t rank)
+:
+        length_(0)
+{
+        auto n = kernels.generators_.size();
+        if (n == 0 || kernels.frequencies_.empty())
+                return;
+
+        // Filters span one multisine period, so generators fall on bins
+        auto duration = kernels.generators_[0] / kernels.frequencies_[0];
+        length_ = std::lround(duration / dt);
+        std::size_t size = 1;
+        while (size < BLOCK_FACTOR * length_)
+                size *= 2;
+        fft_ = Fft(size);
+
+        // Linear kernel, at positive and (conjugate) negative frequencies
+        std::vector<std::complex<double>> conjugate(n);
+        for (std::size_t i = 0; i < n; i++)
+                conjugate[i] = std::conj(kernels.linear_[i]);
+        linear_ = filter(
+                kernels.generators_,
+                kernels.linear_.data(),
+                conjugate.data());
+
+        // Eigenvectors are indexed like Q, over [f1 .. fn, -f1 .. -fn]
+        auto eigenpairs = Eigensolver(rank).solve(
+                kernels.quadratic_,
+                kernels.size_);
+        values_ = eigenpairs.values_;
+        for (std::size_t j = 0; j < values_.size(); j++)
+        {
+                const auto * vector = &eigenpairs.vectors_[j * 2 * n];
+                quadratic_.push_back(
+                        filter(kernels.generators_, vector, vector + n));
+        }
+}
+
+std::size_t Predictor::length() const
+{
+        return length_;
+}
+
+std::vector<double> Predictor::predict(
+        const std::vector<double> & stimulation) const
+{
+        std::vector<double> response(stimulation.size());
+        if (length_ == 0)
+                return response;
+        auto block = fft_.size() - length_ + 1;
+        for (std::size_t first = 0; first < response.size(); first += block)
+                predict_block(stimulation, first, response.data());
+        return response;
+}
+
+std::vector<double> Predictor::predict(
+        const std::vector<double> & stimulation,
+        ThreadPool & pool) const
+{
+        std::vector<double> response(stimulation.size());
+        if (length_ == 0)
+                return response;
+
+        // Blocks write disjoint parts of the response
+        auto block = fft_.size() - length_ + 1;
+        auto count = (response.size() + block - 1) / block;
+        pool.parallel_for(count, [&](std::size_t i)
+        {
+                predict_block(stimulation, i * block, response.data());
+        });
+        return response;
+}
+
+std::size_t Predictor::rank() const
+{
+        return values_.size();
+}
+
+std::vector<std::complex<double>> Predictor::filter(
+        const std::vector<int> & generators,
+        const std::complex<double> * positive,
+        const std::complex<double> * negative) const
+{
+        // Frequency response over one period, linear between generators
+        std::vector<std::complex<double>> response(length_);
+        for (std::size_t i = 0; i < generators.size(); i++)
+        {
+                std::size_t k = generators[i];
+                if (k >= length_)
+                        break;
+                response[k] = positive[i];
+                response[(length_ - k) % length_] = negative[i];
+                if (i + 1 == generators.size())
+                        break;
+                std::size_t next = generators[i + 1];
+                for (auto q = k + 1; q < next && q < length_; q++)
+                {
+                        auto w = double(q - k) / (next - k);
+                        response[q] = (1 - w) * positive[i] +
+                                w * positive[i + 1];
+                        response[length_ - q] = (1 - w) * negative[i] +
+                                w * negative[i + 1];
+                }
+        }
+
+        // Impulse response, centred into a causal filter of the same length
+        // (lag m being at m + length / 2), then padded to the transform size
+        Fft period(length_);
+        period.inverse(response.data());
+        std::vector<std::complex<double>> result(fft_.size());
+        auto half = length_ / 2;
+        for (std::size_t m = 0; m < length_; m++)
+        {
+                result[m] = response[(m + length_ - half) % length_] /
+                        double(length_);
+        }
+        fft_.forward(result.data());
+        return result;
+}
+
+void Predictor::predict_block(
+        const std::vector<double> & stimulation,
+        std::size_t first,
+        double * response) const
+{
+        // Overlap-save: the last size - length + 1 samples of the circular
+        // convolution are those of the linear one
+        auto size = fft_.size();
+        auto block = size - length_ + 1;
+        auto count = std::min(block, stimulation.size() - first);
+        auto start = static_cast<long>(first + length_ / 2) -
+                static_cast<long>(length_ - 1);
+        std::vector<std::complex<double>> input(size);
+        for (std::size_t i = 0; i < size; i++)
+        {
+                auto t = start + static_cast<long>(i);
+                if (t >= 0 && t < static_cast<long>(stimulation.size()))
+                        input[i] = stimulation[t];
+        }
+        fft_.forward(input.data());
+
+        std::vector<std::complex<double>> output(size);
+        auto apply = [&](const std::vector<std::complex<double>> & filter)
+        {
+                for (std::size_t q = 0; q < size; q++)
+                        output[q] = input[q] * filter[q];
+                fft_.inverse(output.data());
+        };
+        apply(linear_);
+        for (std::size_t i = 0; i < count; i++)
+                response[first + i] = output[length_ - 1 + i].real() / size;
+        for (std::size_t j = 0; j < quadratic_.size(); j++)
+        {
+                apply(quadratic_[j]);
+                auto scale = values_[j] / (double(size) * size);
+                for (std::size_t i = 0; i < count; i++)
+                {
+                        response[first + i] +=
+                                scale * std::norm(output[length_ - 1 + i]);
+                }
+        }
+}
+}
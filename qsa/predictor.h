@@ -0,0 +1,87 @@
+/*
+ * Quadratic Sinusoidal Analysis.
+ * Copyright (C) 2018 OpenQSA.
+ * 
+ * This file is part of OpenQSA.
+ * 
+ * OpenQSA is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ * 
+ * OpenQSA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with OpenQSA.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef QSA_PREDICTOR_H
+#define QSA_PREDICTOR_H
+
+#include "analysis.h"
+#include "fft.h"
+#include "threadpool.h"
+
+#include <complex>
+#include <cstddef>
+#include <vector>
+
+namespace Qsa
+{
+// Predicts the response to a stimulation from estimated kernels. Kernels are
+// interpolated between generators, zero outside their band, into filters as
+// long as the multisine period. The linear kernel is one filter, the
+// quadratic matrix Q = sum of l v v* gives one filter per eigenpair, its
+// response being sum of l |v(t)|^2. All are applied by overlap-save FFT
+// convolution, sharing the transform of each block of stimulation. The DC
+// part of the quadratic response is not identified by QSA and is left out.
+class Predictor
+{
+public:
+        // A few eigenpairs hold most of the quadratic response, while each
+        // one costs a filter as long as the multisine period
+        static const std::size_t DEFAULT_RANK;
+
+        Predictor();
+        Predictor(const Predictor &) = default;
+        Predictor & operator=(const Predictor &) = default;
+        ~Predictor() = default;
+
+        // Keeps the rank eigenpairs of largest magnitude, or all 2n of them
+        // if 0
+        explicit Predictor(
+                const Analysis::Kernels & kernels,
+                double dt,
+                std::size_t rank = DEFAULT_RANK);
+
+        std::size_t length() const; // of filters, in samples
+        // Stimulation around its operating point, response likewise
+        std::vector<double> predict(const std::vector<double> & stimulation)
+                const;
+        std::vector<double> predict(
+                const std::vector<double> & stimulation,
+                ThreadPool & pool) const;
+        std::size_t rank() const;
+
+private:
+        std::vector<std::complex<double>> filter(
+                const std::vector<int> & generators,
+                const std::complex<double> * positive,
+                const std::complex<double> * negative) const;
+        void predict_block(
+                const std::vector<double> & stimulation,
+                std::size_t first,
+                double * response) const;
+
+        std::size_t length_;
+        Fft fft_;
+        std::vector<std::complex<double>> linear_;
+        std::vector<std::vector<std::complex<double>>> quadratic_;
+        std::vector<double> values_;
+};
+}
+
+#endif /* QSA_PREDICTOR_H */
@@ -21,11 +21,29 @@
 #ifndef QSA_H
 #define QSA_H
 
+#include "analysis.h"
+#include "buildtask.h"
+#include "decimatingring.h"
+#include "eigensolver.h"
+#include "fft.h"
+#include "fourieraccumulator.h"
 #include "frequencies.h"
 #include "intermodulation.h"
+#include "jsonwriter.h"
+#include "kernelaverage.h"
+#include "multichannelstimulation.h"
+#include "predictor.h"
 #include "recorder.h"
+#include "recording.h"
+#include "recordingreader.h"
+#include "savetask.h"
+#include "sharedstimulation.h"
+#include "snrmonitor.h"
 #include "stimulation.h"
 #include "stimulationbuilder.h"
 #include "stimulationconverter.h"
+#include "stimulationdescriptor.h"
+#include "threadpool.h"
+#include "waveformpyramid.h"
 
 #endif /* QSA_H */
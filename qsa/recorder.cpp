@@ -20,14 +20,14 @@
 
 #include "recorder.h"
 
-#include "version.h"
-
-#include <nlohmann/json.hpp>
-
+#include <algorithm>
 #include <cmath>
-#include <fstream>
 
-using json = nlohmann::json;
+namespace
+{
+// Settling is judged on the last quarter period
+const std::size_t SETTLING_WINDOW_DIVISOR = 4;
+}
 
 namespace Qsa
 {
@@ -35,76 +35,164 @@ Recorder::Recorder()
 :
         sync_(Stimulation::SYNC_OFF),
         started_(false),
-        stopped_(false)
+        stopped_(false),
+        stimulation_(std::make_shared<StimulationDescriptor>()),
+        recording_(std::make_shared<Recording>()),
+        online_spectrum_(false),
+        raw_storage_(true),
+        active_online_spectrum_(false),
+        active_raw_storage_(true),
+        target_snr_(0),
+        target_width_(0),
+        period_(0),
+        averaging_(false),
+        active_averaging_(false),
+        settle_threshold_(0),
+        active_settle_threshold_(0),
+        settling_(false),
+        settled_(false),
+        phase_(0),
+        measure_phase_(0),
+        referenced_{},
+        difference_sum_(0)
 {
 }
 
 void Recorder::push(double in, double out, double sync)
 {
-        auto epsilon = stimulation_.frequencies().dt() / 2;
+        push_run(sync, &in, &out, 1);
+}
 
-        if (abs(sync - Stimulation::SYNC_STEP) < epsilon)
-                push_step(in, out);
-        else if (abs(sync - Stimulation::SYNC_MULTISINE) < epsilon)
-                push_multisine(in, out);
-        else if (abs(sync - Stimulation::SYNC_DROP) < epsilon)
-                push_drop(in, out);
-        else if (abs(sync - Stimulation::SYNC_OFF) < epsilon)
-                stop();
-        else if (abs(sync - Stimulation::SYNC_IGNORE) < epsilon)
-                sync_ = Stimulation::SYNC_IGNORE;
+void Recorder::push_block(
+        const double * in,
+        const double * out,
+        const double * sync,
+        std::size_t count)
+{
+        // Split block into runs of identical sync value, decoded once per run
+        std::size_t first = 0;
+        while (first < count)
+        {
+                auto last = first + 1;
+                while (last < count && sync[last] == sync[first])
+                        last++;
+                push_run(sync[first], in + first, out + first, last - first);
+                first = last;
+        }
+}
+
+std::shared_ptr<const Recording> Recorder::recording() const
+{
+        return recording_;
 }
 
 void Recorder::save(const std::string & filename) const
 {
-        if (traces_.empty())
-                return;
-        json j;
-        j["version"] = Qsa::VERSION;
-        j["dt"] = stimulation_.frequencies().dt();
-        j["duration"] = stimulation_.frequencies().duration();
-        j["frequencies"] = stimulation_.frequencies().fundamentals();
-        j["amplitudes"] = stimulation_.amplitudes();
-        j["phases"] = stimulation_.phases();
-        j["rest_level"] = stimulation_.rest_level();
-        j["step_level"] = stimulation_.step_level();
-        j["step_delay"] = stimulation_.step_delay();
-        j["drop_delay"] = stimulation_.drop_delay();
-        j["trace_count"] = stimulation_.trace_count();
-        j["trace_pause"] = stimulation_.trace_pause();
-        j["trace_alternance"] = stimulation_.trace_alternance();
-        j["traces"] = json::array();
-        for (auto it = traces_.begin(); it != traces_.end(); it++)
-        {
-                json jtrace;
-                jtrace["step"]["time"] = it->step_time_sequence_;
-                jtrace["step"]["stimulation"] = it->step_stimulation_sequence_;
-                jtrace["step"]["response"] = it->step_response_sequence_;
-                //
-                jtrace["multisine"]["time"] = it->multisine_time_sequence_;
-                jtrace["multisine"]["stimulation"] = it->multisine_stimulation_sequence_;
-                jtrace["multisine"]["response"] = it->multisine_response_sequence_;
-                //
-                jtrace["drop"]["time"] = it->drop_time_sequence_;
-                jtrace["drop"]["stimulation"] = it->drop_stimulation_sequence_;
-                jtrace["drop"]["response"] = it->drop_response_sequence_;
-                j["traces"].push_back(jtrace);
-        }
-        std::ofstream file;
-        file.open(filename);
-        file << j;
-        file.close();
-}
-
-void Recorder::set_stimulation(const Stimulation & stimulation)
-{
-        stimulation_ = stimulation;
+        recording_->save(filename);
+}
+
+void Recorder::set_averaging(bool averaging)
+{
+        averaging_ = averaging;
+}
+
+void Recorder::set_online_spectrum(bool online_spectrum)
+{
+        online_spectrum_ = online_spectrum;
+}
+
+void Recorder::set_raw_storage(bool raw_storage)
+{
+        raw_storage_ = raw_storage;
+}
+
+void Recorder::set_settle_threshold(double settle_threshold)
+{
+        settle_threshold_ = settle_threshold;
+}
+
+void Recorder::set_stimulation(const StimulationDescriptor & stimulation)
+{
+        // Parameters only, a waveform would be of no use here
+        stimulation_ = std::make_shared<StimulationDescriptor>(stimulation);
+}
+
+void Recorder::set_target_snr(double target_snr)
+{
+        target_snr_ = target_snr;
+}
+
+void Recorder::set_target_width(double target_width)
+{
+        target_width_ = target_width;
 }
 
 void Recorder::start()
 {
-        traces_ = {};
+        // Previous recording is left untouched for whoever still holds it
+        recording_ = std::make_shared<Recording>(stimulation_);
         cycles_ = 0;
+        auto period = std::lround(
+                stimulation_->frequencies().duration()
+                / stimulation_->frequencies().dt());
+        period_ = period;
+        active_online_spectrum_ = online_spectrum_;
+        active_raw_storage_ = raw_storage_;
+        active_averaging_ = averaging_;
+        if (active_averaging_)
+        {
+                // Sized here as the stimulation sizes its segments, nothing
+                // grows on the real-time thread
+                auto & average = recording_->average_;
+                auto to_ticks = [&](double length)
+                {
+                        return static_cast<std::size_t>(
+                                length / stimulation_->frequencies().dt());
+                };
+                average.positive_.assign(period_, 0);
+                average.negative_.assign(period_, 0);
+                average.step_.assign(to_ticks(stimulation_->step_delay()), 0);
+                average.drop_.assign(to_ticks(stimulation_->drop_delay()), 0);
+        }
+        settling_ = false;
+        settled_ = false;
+        referenced_ = {};
+        active_settle_threshold_ = settle_threshold_;
+        if (active_settle_threshold_ > 0)
+        {
+                for (auto & reference : references_)
+                        reference.assign(period_, 0);
+                differences_.assign(
+                        std::max<std::size_t>(
+                                period_ / SETTLING_WINDOW_DIVISOR,
+                                1),
+                        0);
+        }
+        monitor_ = SnrMonitor();
+        if (monitoring())
+        {
+                // Also project onto the noise bins around them
+                monitor_ = SnrMonitor(*stimulation_);
+                monitor_.set_target_snr(target_snr_);
+                monitor_.set_target_width(target_width_);
+                accumulator_ = FourierAccumulator(monitor_.bins(), period);
+        }
+        else if (active_online_spectrum_)
+        {
+                // Project multisine onto generators and products
+                const auto & intermodulation =
+                        stimulation_->frequencies().intermodulation();
+                std::vector<int> bins(
+                        intermodulation.generators().begin(),
+                        intermodulation.generators().end());
+                bins.insert(
+                        bins.end(),
+                        intermodulation.products().begin(),
+                        intermodulation.products().end());
+                std::sort(bins.begin(), bins.end());
+                bins.erase(std::unique(bins.begin(), bins.end()), bins.end());
+                accumulator_ = FourierAccumulator(bins, period);
+        }
         sync_ = Stimulation::SYNC_OFF;
         started_ = false; // Not really started before first step
         stopped_ = false;
@@ -115,9 +203,24 @@ bool Recorder::started() const
         return started_;
 }
 
-const Stimulation & Recorder::stimulation() const
+bool Recorder::settled() const
+{
+        return settled_;
+}
+
+bool Recorder::should_stop() const
+{
+        return monitor_.satisfied();
+}
+
+const SnrMonitor & Recorder::snr_monitor() const
+{
+        return monitor_;
+}
+
+const StimulationDescriptor & Recorder::stimulation() const
 {
-        return stimulation_;
+        return *stimulation_;
 }
 
 void Recorder::stop()
@@ -133,73 +236,262 @@ bool Recorder::stopped() const
         return stopped_;
 }
 
-void Recorder::push_step(double in, double out)
+void Recorder::begin_segment(Recording::Segment & segment, double length)
+{
+        cycles_ = length / stimulation_->frequencies().dt();
+        segment.start_tick_ = cycles_;
+        if (active_raw_storage_)
+        {
+                segment.stimulation_.reserve(cycles_ + 1);
+                segment.response_.reserve(cycles_ + 1);
+        }
+}
+
+void Recorder::fold(
+        std::vector<double> & mean,
+        int traces,
+        long index,
+        const double * out,
+        std::size_t count)
+{
+        // Running mean over traces, sized by start()
+        for (std::size_t i = 0; i < count; i++, index++)
+        {
+                if (index < static_cast<long>(mean.size()))
+                        mean[index] += (out[i] - mean[index]) / traces;
+        }
+}
+
+void Recorder::push_run(
+        double sync,
+        const double * in,
+        const double * out,
+        std::size_t count)
+{
+        // Sync codes are integers, reject values too far from the nearest one
+        auto epsilon = stimulation_->frequencies().dt() / 2;
+        auto code = std::lround(sync);
+        if (std::abs(sync - code) >= epsilon)
+                return;
+
+        switch (code)
+        {
+        case Stimulation::SYNC_STEP:
+                push_step(in, out, count);
+                break;
+        case Stimulation::SYNC_MULTISINE:
+                push_multisine(in, out, count);
+                break;
+        case Stimulation::SYNC_DROP:
+                push_drop(in, out, count);
+                break;
+        case Stimulation::SYNC_OFF:
+                stop();
+                break;
+        case Stimulation::SYNC_IGNORE:
+                push_settling(out, count);
+                break;
+        default:
+                break;
+        }
+}
+
+void Recorder::push_step(
+        const double * in,
+        const double * out,
+        std::size_t count)
 {
+        auto & traces = recording_->traces_;
+        auto & average = recording_->average_;
         if (sync_ != Stimulation::SYNC_STEP)
         {
                 // Real start
                 started_ = true;
                 // Create trace
-                traces_.push_back({});
+                traces.push_back({});
                 // Switch to STEP mode
-                cycles_ =
-                        stimulation_.step_delay()
-                        / stimulation_.frequencies().dt();
+                begin_segment(traces.back().step_, stimulation_->step_delay());
                 sync_ = Stimulation::SYNC_STEP;
+                if (active_averaging_)
+                        average.step_count_++;
         }
-        if (cycles_ >= 0)
-        {
-                // Record time, stimulation, response
-                auto elapsed = cycles_ * stimulation_.frequencies().dt();
-                auto t = stimulation_.step_delay() - elapsed;
-                traces_.back().step_time_sequence_.push_back(t);
-                traces_.back().step_stimulation_sequence_.push_back(in);
-                traces_.back().step_response_sequence_.push_back(out);
-                cycles_--;
-        }
+        auto & segment = traces.back().step_;
+        auto index = segment.start_tick_ - cycles_;
+        count = record(segment, in, out, count);
+        if (active_averaging_)
+                fold(average.step_, average.step_count_, index, out, count);
 }
 
-void Recorder::push_multisine(double in, double out)
+void Recorder::push_multisine(
+        const double * in,
+        const double * out,
+        std::size_t count)
 {
+        auto & traces = recording_->traces_;
+        auto & average = recording_->average_;
+        auto positive = trace_sign() > 0;
         if (sync_ != Stimulation::SYNC_MULTISINE)
         {
                 // Switch to MULTISINE mode
-                cycles_ =
-                        stimulation_.frequencies().duration()
-                        / stimulation_.frequencies().dt();
+                begin_segment(
+                        traces.back().multisine_,
+                        stimulation_->frequencies().duration());
                 sync_ = Stimulation::SYNC_MULTISINE;
+                // Settling may have been cut short, mid-period
+                settling_ = false;
+                settled_ = false;
+                measure_phase_ = phase_;
+                accumulator_.reset(phase_);
+                if (active_averaging_)
+                {
+                        positive ?
+                                average.positive_count_++ :
+                                average.negative_count_++;
+                }
         }
-        if (cycles_ >= 0)
+        count = record(traces.back().multisine_, in, out, count);
+        auto measured = phase_ - measure_phase_;
+        if (active_averaging_ && period_ > 0)
         {
-                // Record time, stimulation, response
-                auto elapsed = cycles_ * stimulation_.frequencies().dt();
-                auto t = stimulation_.frequencies().duration() - elapsed;
-                traces_.back().multisine_time_sequence_.push_back(t);
-                traces_.back().multisine_stimulation_sequence_.push_back(in);
-                traces_.back().multisine_response_sequence_.push_back(out);
-                cycles_--;
+                // Fold the measured period into the mean of its sign, by phase
+                auto & mean = positive ? average.positive_ : average.negative_;
+                auto traces = positive ?
+                        average.positive_count_ :
+                        average.negative_count_;
+                for (std::size_t i = 0; i < count; i++)
+                {
+                        if (measured + i >= period_)
+                                break;
+                        auto & value = mean[(phase_ + i) % period_];
+                        value += (out[i] - value) / traces;
+                }
+        }
+        if (active_settle_threshold_ > 0 && period_ > 0)
+        {
+                // Keep the settled response as reference for next traces
+                auto sign = positive ? 0 : 1;
+                for (std::size_t i = 0; i < count; i++)
+                {
+                        references_[sign][(phase_ + i) % period_] = out[i];
+                        if (measured + i + 1 == period_)
+                                referenced_[sign] = true;
+                }
+        }
+        phase_ += count;
+        auto accumulating = active_online_spectrum_ || monitoring();
+        if (accumulating && !accumulator_.complete())
+        {
+                accumulator_.push(in, out, count);
+                if (accumulator_.complete())
+                {
+                        // First period is over, keep only its coefficients
+                        if (active_online_spectrum_)
+                        {
+                                auto & spectrum = traces.back().spectrum_;
+                                spectrum.bins_ = accumulator_.bins();
+                                spectrum.stimulation_ =
+                                        accumulator_.stimulation();
+                                spectrum.response_ = accumulator_.response();
+                        }
+                        if (monitoring())
+                        {
+                                monitor_.add(
+                                        accumulator_.response(),
+                                        trace_sign());
+                        }
+                }
         }
 }
 
-void Recorder::push_drop(double in, double out)
+void Recorder::push_drop(
+        const double * in,
+        const double * out,
+        std::size_t count)
 {
+        auto & traces = recording_->traces_;
+        auto & average = recording_->average_;
         if (sync_ != Stimulation::SYNC_DROP)
         {
                 // Switch to DROP mode
-                cycles_ =
-                        stimulation_.drop_delay()
-                        / stimulation_.frequencies().dt();
+                begin_segment(traces.back().drop_, stimulation_->drop_delay());
                 sync_ = Stimulation::SYNC_DROP;
+                if (active_averaging_)
+                        average.drop_count_++;
+        }
+        auto & segment = traces.back().drop_;
+        auto index = segment.start_tick_ - cycles_;
+        count = record(segment, in, out, count);
+        if (active_averaging_)
+                fold(average.drop_, average.drop_count_, index, out, count);
+}
+
+void Recorder::push_settling(const double * out, std::size_t count)
+{
+        if (sync_ == Stimulation::SYNC_STEP)
+        {
+                // Multisine begins with a period to let transients settle
+                settling_ = true;
+                settled_ = false;
+                phase_ = 0;
+                difference_sum_ = 0;
+                std::fill(differences_.begin(), differences_.end(), 0.0);
         }
-        if (cycles_ >= 0)
+        sync_ = Stimulation::SYNC_IGNORE;
+        if (!settling_)
+                return;
+
+        auto sign = trace_sign() > 0 ? 0 : 1;
+        auto compare = active_settle_threshold_ > 0 && referenced_[sign];
+        auto window = differences_.size();
+        for (std::size_t i = 0; i < count; i++, phase_++)
         {
-                // Record time, stimulation, response
-                auto elapsed = cycles_ * stimulation_.frequencies().dt();
-                auto t = stimulation_.drop_delay() - elapsed;
-                traces_.back().drop_time_sequence_.push_back(t);
-                traces_.back().drop_stimulation_sequence_.push_back(in);
-                traces_.back().drop_response_sequence_.push_back(out);
-                cycles_--;
+                if (!compare || settled_)
+                        continue;
+                // Mean squared difference to the reference, over the window
+                auto difference = out[i] - references_[sign][phase_ % period_];
+                auto & slot = differences_[phase_ % window];
+                difference_sum_ += difference * difference - slot;
+                slot = difference * difference;
+                auto threshold =
+                        active_settle_threshold_ * active_settle_threshold_;
+                if (phase_ + 1 >= window &&
+                        difference_sum_ <= threshold * window)
+                        settled_ = true;
         }
 }
+
+bool Recorder::monitoring() const
+{
+        return target_snr_ > 0 || target_width_ > 0;
+}
+
+std::size_t Recorder::record(
+        Recording::Segment & segment,
+        const double * in,
+        const double * out,
+        std::size_t count)
+{
+        if (cycles_ < 0)
+                return 0;
+
+        // Record stimulation, response (time is implicit) in bulk
+        auto n = std::min<std::size_t>(count, cycles_ + 1);
+        if (active_raw_storage_)
+        {
+                segment.stimulation_.insert(
+                        segment.stimulation_.end(),
+                        in,
+                        in + n);
+                segment.response_.insert(segment.response_.end(), out, out + n);
+        }
+        cycles_ -= n;
+        return n;
+}
+
+int Recorder::trace_sign() const
+{
+        // Odd traces are inverted when alternating
+        auto odd = recording_->traces_.size() % 2 == 0;
+        return stimulation_->trace_alternance() < 0 && odd ? -1 : +1;
+}
 }
@@ -21,8 +21,15 @@
 #ifndef QSA_RECORDER_H
 #define QSA_RECORDER_H
 
+#include "fourieraccumulator.h"
+#include "recording.h"
+#include "snrmonitor.h"
 #include "stimulation.h"
 
+#include <array>
+#include <cstddef>
+#include <memory>
+#include <string>
 #include <vector>
 
 namespace Qsa
@@ -36,40 +43,102 @@ public:
         ~Recorder() = default;
 
         void push(double in, double out, double sync);
+        void push_block(
+                const double * in,
+                const double * out,
+                const double * sync,
+                std::size_t count);
+        std::shared_ptr<const Recording> recording() const;
         void save(const std::string & filename) const;
-        void set_stimulation(const Stimulation & stimulation);
+        // Keeps mean responses over traces, see Recording::Average.
+        // Applies from the next start() on.
+        void set_averaging(bool averaging);
+        // Fourier coefficients of each trace, computed while recording
+        // instead of from its samples. Applies from the next start() on.
+        void set_online_spectrum(bool online_spectrum);
+        // Applies from the next start() on
+        void set_raw_storage(bool raw_storage);
+        // Applies from the next start() on, as the other settings do
+        void set_settle_threshold(double settle_threshold);
+        void set_stimulation(const StimulationDescriptor & stimulation);
+        void set_target_snr(double target_snr);
+        void set_target_width(double target_width);
+        // True once the traces recorded so far meet the targets
+        bool should_stop() const;
+        const SnrMonitor & snr_monitor() const;
+        // True once the multisine being played, still settling, responds
+        // like the previous trace of the same sign did once settled
+        bool settled() const;
         void start();
         bool started() const;
-        const Stimulation & stimulation() const;
+        const StimulationDescriptor & stimulation() const;
         void stop();
         bool stopped() const;
 
 private:
-        struct Trace
-        {
-                std::vector<double> step_time_sequence_;
-                std::vector<double> step_stimulation_sequence_;
-                std::vector<double> step_response_sequence_;
-                //
-                std::vector<double> multisine_time_sequence_;
-                std::vector<double> multisine_stimulation_sequence_;
-                std::vector<double> multisine_response_sequence_;
-                //
-                std::vector<double> drop_time_sequence_;
-                std::vector<double> drop_stimulation_sequence_;
-                std::vector<double> drop_response_sequence_;
-        };
-
-        void push_step(double in, double out);
-        void push_multisine(double in, double out);
-        void push_drop(double in, double out);
+        void begin_segment(Recording::Segment & segment, double length);
+        void fold(
+                std::vector<double> & mean,
+                int traces,
+                long index,
+                const double * out,
+                std::size_t count);
+        void push_run(
+                double sync,
+                const double * in,
+                const double * out,
+                std::size_t count);
+        void push_step(
+                const double * in,
+                const double * out,
+                std::size_t count);
+        void push_multisine(
+                const double * in,
+                const double * out,
+                std::size_t count);
+        void push_drop(
+                const double * in,
+                const double * out,
+                std::size_t count);
+        void push_settling(const double * out, std::size_t count);
+        bool monitoring() const;
+        std::size_t record(
+                Recording::Segment & segment,
+                const double * in,
+                const double * out,
+                std::size_t count);
+        int trace_sign() const;
 
         Stimulation::Sync sync_;
         bool started_;
         bool stopped_;
-        Stimulation stimulation_;
+        std::shared_ptr<const StimulationDescriptor> stimulation_;
         long cycles_;
-        std::vector<Trace> traces_;
+        std::shared_ptr<Recording> recording_;
+        bool online_spectrum_;
+        bool raw_storage_;
+        // Latched by start()
+        bool active_online_spectrum_;
+        bool active_raw_storage_;
+        FourierAccumulator accumulator_;
+        double target_snr_;
+        double target_width_;
+        SnrMonitor monitor_;
+        std::size_t period_;
+        bool averaging_;
+        bool active_averaging_; // Latched by start() as well
+        double settle_threshold_;
+        // Latched by start(), setters only apply to the next recording
+        double active_settle_threshold_;
+        bool settling_;
+        bool settled_;
+        std::size_t phase_; // samples since the multisine began
+        std::size_t measure_phase_;
+        // Settled response over a period, per trace sign
+        std::array<std::vector<double>, 2> references_;
+        std::array<bool, 2> referenced_;
+        std::vector<double> differences_; // squared, over the last window
+        double difference_sum_;
 };
 }
 
@@ -0,0 +1,278 @@
+/*
+ * Quadratic Sinusoidal Analysis.
+ * Copyright (C) 2018 OpenQSA.
+ * 
+ * This file is part of OpenQSA.
+ * 
+ * OpenQSA is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ * 
+ * OpenQSA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with OpenQSA.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "recording.h"
+
+#include "jsonwriter.h"
+#include "recordingreader.h"
+#include "version.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <thread>
+
+namespace Qsa
+{
+Recording::Recording()
+:
+        stimulation_(std::make_shared<StimulationDescriptor>())
+{
+}
+
+Recording::Recording(
+        std::shared_ptr<const StimulationDescriptor> stimulation)
+:
+        stimulation_(stimulation)
+{
+}
+
+const Recording::Average & Recording::average() const
+{
+        return average_;
+}
+
+std::vector<double> Recording::even_response() const
+{
+        // Quadratic (and higher even) orders do not change sign
+        std::vector<double> result;
+        if (average_.positive_count_ == 0 || average_.negative_count_ == 0)
+                return result;
+        for (std::size_t i = 0; i < average_.positive_.size(); i++)
+                result.push_back(
+                        (average_.positive_[i] + average_.negative_[i]) / 2);
+        return result;
+}
+
+Recording Recording::load(const std::string & filename)
+{
+        std::vector<Trace> traces;
+        Average average;
+        auto stimulation = RecordingReader(filename).read(
+                [&](const StimulationDescriptor &, Trace & trace)
+                {
+                        traces.push_back(std::move(trace));
+                },
+                {},
+                &average);
+        Recording recording(stimulation);
+        recording.average_ = std::move(average);
+        recording.traces_ = std::move(traces);
+        return recording;
+}
+
+std::vector<double> Recording::odd_response() const
+{
+        // Linear (and higher odd) orders follow the sign of the stimulation
+        std::vector<double> result;
+        if (average_.positive_count_ == 0 || average_.negative_count_ == 0)
+                return result;
+        for (std::size_t i = 0; i < average_.positive_.size(); i++)
+                result.push_back(
+                        (average_.positive_[i] - average_.negative_[i]) / 2);
+        return result;
+}
+
+bool Recording::save(
+        const std::string & filename,
+        const Progress & progress) const
+{
+        // Nothing recorded, no file
+        if (traces_.empty())
+                return false;
+        std::ofstream file;
+        file.open(filename);
+        if (!file.is_open())
+                return false;
+        JsonWriter writer(file);
+
+        // Keys are written in the same (sorted) order as nlohmann::json
+        writer.begin_object();
+        writer.key("amplitudes").value(stimulation_->amplitudes());
+        if (average_.step_count_ > 0)
+        {
+                writer.key("average").begin_object();
+                writer.key("drop").value(average_.drop_);
+                writer.key("drop_count").value(average_.drop_count_);
+                writer.key("negative").value(average_.negative_);
+                writer.key("negative_count").value(average_.negative_count_);
+                writer.key("positive").value(average_.positive_);
+                writer.key("positive_count").value(average_.positive_count_);
+                writer.key("step").value(average_.step_);
+                writer.key("step_count").value(average_.step_count_);
+                writer.end_object();
+        }
+        writer.key("drop_delay").value(stimulation_->drop_delay());
+        writer.key("dt").value(stimulation_->frequencies().dt());
+        writer.key("duration").value(stimulation_->frequencies().duration());
+        writer.key("frequencies").value(
+                stimulation_->frequencies().fundamentals());
+        writer.key("phases").value(stimulation_->phases());
+        writer.key("rest_level").value(stimulation_->rest_level());
+        writer.key("step_delay").value(stimulation_->step_delay());
+        writer.key("step_level").value(stimulation_->step_level());
+        writer.key("trace_alternance").value(stimulation_->trace_alternance());
+        writer.key("trace_count").value(stimulation_->trace_count());
+        writer.key("trace_pause").value(stimulation_->trace_pause());
+        writer.key("traces").begin_array();
+
+        // Format traces in parallel, one chunk per thread, then write them
+        // in order (memory is bounded by one chunk per thread)
+        std::size_t concurrency = std::max(
+                1U,
+                std::thread::hardware_concurrency());
+        std::vector<std::string> chunks(concurrency);
+        for (
+                std::size_t first = 0;
+                first < traces_.size();
+                first += concurrency)
+        {
+                auto count = std::min(concurrency, traces_.size() - first);
+                std::vector<std::thread> threads;
+                for (std::size_t i = 1; i < count; i++)
+                {
+                        threads.emplace_back(
+                                [&, i]()
+                                {
+                                        chunks[i] = format_trace(
+                                                traces_[first + i]);
+                                });
+                }
+                chunks[0] = format_trace(traces_[first]);
+                for (auto & thread : threads)
+                        thread.join();
+                for (std::size_t i = 0; i < count; i++)
+                {
+                        writer.raw(chunks[i]);
+                        chunks[i] = {};
+                }
+                auto fraction = double(first + count) / traces_.size();
+                if (progress && !progress(fraction))
+                {
+                        // Cancelled, do not leave a truncated file behind
+                        writer.release();
+                        file.close();
+                        std::remove(filename.c_str());
+                        return false;
+                }
+        }
+
+        writer.end_array();
+        writer.key("version").value(Qsa::VERSION);
+        writer.end_object();
+        writer.flush();
+        file.close();
+        if (!file.good())
+        {
+                // Disk full or the like, the file is unusable
+                std::remove(filename.c_str());
+                return false;
+        }
+        return true;
+}
+
+const StimulationDescriptor & Recording::stimulation() const
+{
+        return *stimulation_;
+}
+
+std::shared_ptr<const StimulationDescriptor> Recording::stream(
+        const std::string & filename,
+        const TraceHandler & handler)
+{
+        return RecordingReader(filename).read(handler);
+}
+
+std::vector<double> Recording::time(
+        const Segment & segment,
+        double length) const
+{
+        // Same arithmetic as when time was recorded along with samples
+        auto dt = stimulation_->frequencies().dt();
+        std::vector<double> result(segment.response_.size());
+        for (std::size_t i = 0; i < result.size(); i++)
+        {
+                auto cycles = segment.start_tick_ - static_cast<long>(i);
+                result[i] = length - cycles * dt;
+        }
+        return result;
+}
+
+const std::vector<Recording::Trace> & Recording::traces() const
+{
+        return traces_;
+}
+
+std::string Recording::format_trace(const Trace & trace) const
+{
+        auto write = [&](
+                JsonWriter & writer,
+                const std::string & name,
+                const Segment & segment,
+                double length)
+        {
+                writer.key(name).begin_object();
+                writer.key("response").value(segment.response_);
+                writer.key("stimulation").value(segment.stimulation_);
+                writer.key("time").value(time(segment, length));
+                writer.end_object();
+        };
+        auto write_complex = [&](
+                JsonWriter & writer,
+                const std::string & name,
+                const std::vector<std::complex<double>> & values)
+        {
+                std::vector<double> real;
+                std::vector<double> imag;
+                for (auto value : values)
+                {
+                        real.push_back(value.real());
+                        imag.push_back(value.imag());
+                }
+                writer.key(name).begin_object();
+                writer.key("imag").value(imag);
+                writer.key("real").value(real);
+                writer.end_object();
+        };
+        JsonWriter writer;
+        writer.begin_object();
+        write(writer, "drop", trace.drop_, stimulation_->drop_delay());
+        write(
+                writer,
+                "multisine",
+                trace.multisine_,
+                stimulation_->frequencies().duration());
+        if (!trace.spectrum_.bins_.empty())
+        {
+                writer.key("spectrum").begin_object();
+                writer.key("bins").value(trace.spectrum_.bins_);
+                write_complex(writer, "response", trace.spectrum_.response_);
+                write_complex(
+                        writer,
+                        "stimulation",
+                        trace.spectrum_.stimulation_);
+                writer.end_object();
+        }
+        write(writer, "step", trace.step_, stimulation_->step_delay());
+        writer.end_object();
+        return writer.release();
+}
+}
@@ -0,0 +1,124 @@
+/*
+ * Quadratic Sinusoidal Analysis.
+ * Copyright (C) 2018 OpenQSA.
+ * 
+ * This file is part of OpenQSA.
+ * 
+ * OpenQSA is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ * 
+ * OpenQSA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with OpenQSA.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef QSA_RECORDING_H
+#define QSA_RECORDING_H
+
+#include "stimulationdescriptor.h"
+
+#include <complex>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Qsa
+{
+class Recording
+{
+public:
+        // Time is not stored: sample i of a segment was recorded
+        // (start_tick_ - i) ticks before the end of the segment
+        struct Segment
+        {
+                long start_tick_{};
+                std::vector<double> stimulation_;
+                std::vector<double> response_;
+        };
+
+        // Fourier coefficients of the first multisine period, when computed
+        // online by the recorder (see FourierAccumulator)
+        struct Spectrum
+        {
+                std::vector<int> bins_;
+                std::vector<std::complex<double>> stimulation_;
+                std::vector<std::complex<double>> response_;
+        };
+
+        // Mean responses over traces, computed online by the recorder: one
+        // multisine period (from phase 0) per trace sign, so that with
+        // alternating traces their half sum holds even orders and their half
+        // difference odd orders, and step and drop baselines
+        struct Average
+        {
+                std::vector<double> positive_;
+                std::vector<double> negative_;
+                std::vector<double> step_;
+                std::vector<double> drop_;
+                int positive_count_{};
+                int negative_count_{};
+                int step_count_{};
+                int drop_count_{};
+        };
+
+        struct Trace
+        {
+                Segment step_;
+                Segment multisine_;
+                Spectrum spectrum_;
+                Segment drop_;
+        };
+
+        // Called with the fraction of traces written, returns false to abort
+        using Progress = std::function<bool(double)>;
+
+        // Called with each trace read, which may be moved from
+        using TraceHandler = std::function<void(
+                const StimulationDescriptor & stimulation,
+                Trace & trace)>;
+
+        Recording();
+        Recording(const Recording &) = default;
+        Recording & operator=(const Recording &) = default;
+        ~Recording() = default;
+
+        explicit Recording(
+                std::shared_ptr<const StimulationDescriptor> stimulation);
+
+        const Average & average() const;
+        std::vector<double> even_response() const; // empty if unknown
+        static Recording load(const std::string & filename);
+        std::vector<double> odd_response() const; // empty if unknown
+        // False if nothing was recorded, if it was cancelled or if the file
+        // could not be written
+        bool save(
+                const std::string & filename,
+                const Progress & progress = {}) const;
+        const StimulationDescriptor & stimulation() const;
+        // Reads a saved recording without keeping its traces in memory, each
+        // trace being handed over before the next one is read
+        static std::shared_ptr<const StimulationDescriptor> stream(
+                const std::string & filename,
+                const TraceHandler & handler);
+        std::vector<double> time(const Segment & segment, double length) const;
+        const std::vector<Trace> & traces() const;
+
+private:
+        std::string format_trace(const Trace & trace) const;
+
+        std::shared_ptr<const StimulationDescriptor> stimulation_;
+        Average average_;
+        std::vector<Trace> traces_;
+
+        friend class Recorder;
+};
+}
+
+#endif /* QSA_RECORDING_H */
@@ -0,0 +1,893 @@
+/*
+ * Quadratic Sinusoidal Analysis.
+ * Copyright (C) 2018 OpenQSA.
+ * 
+ * This file is part of OpenQSA.
+ * 
+ * OpenQSA is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ * 
+ * OpenQSA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with OpenQSA.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "recordingreader.h"
+
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <stdexcept>
+#include <vector>
+
+namespace
+{
+using json = nlohmann::json;
+
+// Samples handed to a sink at once
+const std::size_t BLOCK_SIZE = 4096;
+
+// Keys of the top-level object, but traces
+struct Header
+{
+        std::map<std::string, double> numbers;
+        std::map<std::string, std::vector<double>> arrays;
+};
+
+// Header keys needed to make the stimulation
+const char * NUMBER_KEYS[] = {
+        "dt", "duration", "rest_level", "step_level", "step_delay",
+        "drop_delay", "trace_count", "trace_pause", "trace_alternance"};
+const char * ARRAY_KEYS[] = {"amplitudes", "frequencies", "phases"};
+
+using Make = std::function<std::shared_ptr<const Qsa::StimulationDescriptor>(
+        const Header & header)>;
+
+// SAX handler following the path of each value in the document:
+//   depth 1: header keys, average or traces
+//   depth 2: average keys
+//   depth 3: trace keys, step, multisine, drop or spectrum
+//   depth 4: segment keys, time, stimulation or response,
+//            or spectrum keys, bins, stimulation or response
+//   depth 5: spectrum coefficient keys, real or imag
+// Keys may come in any order. Traces read before the header is complete are
+// kept whole, then handed over, samples included, once it is.
+class Handler : public nlohmann::json_sax<json>
+{
+public:
+        Handler(
+                const std::string & name,
+                const Make & make,
+                const Qsa::Recording::TraceHandler & handler,
+                const Qsa::RecordingReader::Sink & sink,
+                Qsa::Recording::Average * average)
+        :
+                name_(name),
+                make_(make),
+                handler_(handler),
+                sink_(sink),
+                average_(average != nullptr ? average : &ignored_average_)
+        {
+        }
+
+        // Once the document is parsed
+        std::shared_ptr<const Qsa::StimulationDescriptor> finish()
+        {
+                // Recording without traces, or header after them
+                if (!stimulation_)
+                        stimulation_ = make_(header_);
+                for (auto & pending : pending_)
+                        deliver(
+                                pending.trace_,
+                                pending.index_,
+                                pending.first_time_,
+                                pending.time_seen_);
+                pending_.clear();
+                return stimulation_;
+        }
+
+        bool null() override
+        {
+                return number(std::numeric_limits<double>::quiet_NaN());
+        }
+
+        bool boolean(bool) override
+        {
+                return true;
+        }
+
+        bool number_integer(number_integer_t value) override
+        {
+                return number(value);
+        }
+
+        bool number_unsigned(number_unsigned_t value) override
+        {
+                return number(value);
+        }
+
+        bool number_float(number_float_t value, const string_t &) override
+        {
+                return number(value);
+        }
+
+        bool string(string_t &) override
+        {
+                return true;
+        }
+
+        bool start_object(std::size_t) override
+        {
+                if (depth_ == 2 && in_traces())
+                        begin_trace();
+                depth_++;
+                return true;
+        }
+
+        bool key(string_t & value) override
+        {
+                if (depth_ < KEY_DEPTH)
+                        keys_[depth_] = value;
+                return true;
+        }
+
+        bool end_object() override
+        {
+                depth_--;
+                if (depth_ == 2 && in_traces())
+                        end_trace();
+                return true;
+        }
+
+        bool start_array(std::size_t) override
+        {
+                if (depth_ == 1 && in_traces() && header_complete())
+                        stimulation_ = make_(header_);
+                else if (depth_ == 1)
+                        target_ = &header_.arrays[keys_[1]];
+                else if (depth_ == 2 && in_average())
+                        select_average_array();
+                else if (depth_ >= 4 && in_traces())
+                        select_trace_array();
+                depth_++;
+                return true;
+        }
+
+        bool end_array() override
+        {
+                depth_--;
+                if (array_ >= 0 && count_ > 0)
+                        flush();
+                target_ = nullptr;
+                time_ = nullptr;
+                array_ = -1;
+                return true;
+        }
+
+        bool parse_error(
+                std::size_t,
+                const std::string &,
+                const nlohmann::detail::exception & exception) override
+        {
+                throw std::runtime_error(name_ + ": " + exception.what());
+        }
+
+private:
+        static const int KEY_DEPTH = 6;
+
+        // Trace with the first time of each segment, to recover start ticks
+        struct Pending
+        {
+                Qsa::Recording::Trace trace_;
+                std::size_t index_;
+                double first_time_[3];
+                bool time_seen_[3];
+        };
+
+        bool header_complete() const
+        {
+                for (auto key : NUMBER_KEYS)
+                {
+                        if (header_.numbers.count(key) == 0)
+                                return false;
+                }
+                for (auto key : ARRAY_KEYS)
+                {
+                        if (header_.arrays.count(key) == 0)
+                                return false;
+                }
+                return true;
+        }
+
+        bool in_average() const
+        {
+                return keys_[1] == "average";
+        }
+
+        bool in_traces() const
+        {
+                return keys_[1] == "traces";
+        }
+
+        bool number(double value)
+        {
+                if (time_ != nullptr)
+                {
+                        // Only the first time matters, others follow by dt
+                        if (!time_seen_[time_ - first_time_])
+                                *time_ = value;
+                        time_seen_[time_ - first_time_] = true;
+                }
+                else if (array_ >= 0)
+                {
+                        block_[count_++] = value;
+                        if (count_ == BLOCK_SIZE)
+                                flush();
+                }
+                else if (target_ != nullptr)
+                        target_->push_back(value);
+                else if (depth_ == 1)
+                        header_.numbers[keys_[1]] = value;
+                else if (depth_ == 2 && in_average())
+                {
+                        const auto & name = keys_[2];
+                        auto count = static_cast<int>(value);
+                        if (name == "positive_count")
+                                average_->positive_count_ = count;
+                        else if (name == "negative_count")
+                                average_->negative_count_ = count;
+                        else if (name == "step_count")
+                                average_->step_count_ = count;
+                        else if (name == "drop_count")
+                                average_->drop_count_ = count;
+                }
+                return true;
+        }
+
+        void begin_trace()
+        {
+                // Vectors keep the capacity of the previous trace
+                auto reserve = [](std::vector<double> & values)
+                {
+                        auto capacity = values.capacity();
+                        values.clear();
+                        values.reserve(capacity);
+                };
+                for (auto segment : {&trace_.step_, &trace_.multisine_,
+                        &trace_.drop_})
+                {
+                        reserve(segment->stimulation_);
+                        reserve(segment->response_);
+                        segment->start_tick_ = 0;
+                }
+                trace_.spectrum_ = {};
+                for (auto values : {&bins_, &stimulation_real_,
+                        &stimulation_imag_, &response_real_,
+                        &response_imag_})
+                        values->clear();
+                for (auto & seen : time_seen_)
+                        seen = false;
+        }
+
+        void deliver(
+                Qsa::Recording::Trace & trace,
+                std::size_t index,
+                const double * first_time,
+                const bool * time_seen)
+        {
+                // Segments end at their nominal length
+                const auto & frequencies = stimulation_->frequencies();
+                double lengths[] = {
+                        stimulation_->step_delay(),
+                        frequencies.duration(),
+                        stimulation_->drop_delay()};
+                Qsa::Recording::Segment * segments[] = {
+                        &trace.step_,
+                        &trace.multisine_,
+                        &trace.drop_};
+                for (auto s = 0; s < 3; s++)
+                {
+                        if (time_seen[s])
+                                segments[s]->start_tick_ = std::lround(
+                                        (lengths[s] - first_time[s]) /
+                                        frequencies.dt());
+                }
+
+                // Samples kept while the header was incomplete
+                if (sink_)
+                {
+                        for (auto s = 0; s < 3; s++)
+                        {
+                                hand_over(
+                                        index,
+                                        2 * s,
+                                        segments[s]->stimulation_);
+                                hand_over(
+                                        index,
+                                        2 * s + 1,
+                                        segments[s]->response_);
+                        }
+                }
+                handler_(*stimulation_, trace);
+        }
+
+        void end_trace()
+        {
+                auto & spectrum = trace_.spectrum_;
+                for (auto bin : bins_)
+                        spectrum.bins_.push_back(static_cast<int>(bin));
+                auto combine = [](
+                        const std::vector<double> & real,
+                        const std::vector<double> & imag)
+                {
+                        std::vector<std::complex<double>> result;
+                        for (std::size_t i = 0; i < real.size(); i++)
+                                result.emplace_back(
+                                        real[i],
+                                        i < imag.size() ? imag[i] : 0);
+                        return result;
+                };
+                spectrum.stimulation_ = combine(
+                        stimulation_real_,
+                        stimulation_imag_);
+                spectrum.response_ = combine(response_real_, response_imag_);
+
+                if (stimulation_)
+                        deliver(trace_, trace_index_, first_time_, time_seen_);
+                else
+                {
+                        Pending pending{trace_, trace_index_, {}, {}};
+                        std::copy_n(first_time_, 3, pending.first_time_);
+                        std::copy_n(time_seen_, 3, pending.time_seen_);
+                        pending_.push_back(std::move(pending));
+                }
+                trace_index_++;
+        }
+
+        void flush()
+        {
+                sink_(trace_index_,
+                        static_cast<Qsa::RecordingReader::Array>(array_),
+                        block_,
+                        count_);
+                count_ = 0;
+        }
+
+        // Samples to the sink, block by block
+        void hand_over(
+                std::size_t index,
+                int array,
+                std::vector<double> & samples)
+        {
+                for (std::size_t i = 0; i < samples.size(); i += BLOCK_SIZE)
+                {
+                        sink_(index,
+                                static_cast<Qsa::RecordingReader::Array>(
+                                        array),
+                                samples.data() + i,
+                                std::min(BLOCK_SIZE, samples.size() - i));
+                }
+                samples.clear();
+        }
+
+        void select_average_array()
+        {
+                const auto & name = keys_[2];
+                if (name == "positive")
+                        target_ = &average_->positive_;
+                else if (name == "negative")
+                        target_ = &average_->negative_;
+                else if (name == "step")
+                        target_ = &average_->step_;
+                else if (name == "drop")
+                        target_ = &average_->drop_;
+                if (target_ != nullptr)
+                        target_->clear();
+        }
+
+        void select_trace_array()
+        {
+                if (keys_[3] == "spectrum")
+                {
+                        const auto & name = keys_[4];
+                        if (depth_ == 4 && name == "bins")
+                                target_ = &bins_;
+                        else if (depth_ == 5 && name == "stimulation")
+                                target_ = keys_[5] == "real" ?
+                                        &stimulation_real_ :
+                                        &stimulation_imag_;
+                        else if (depth_ == 5 && name == "response")
+                                target_ = keys_[5] == "real" ?
+                                        &response_real_ :
+                                        &response_imag_;
+                        return;
+                }
+
+                int s;
+                Qsa::Recording::Segment * segment;
+                if (keys_[3] == "step")
+                {
+                        s = 0;
+                        segment = &trace_.step_;
+                }
+                else if (keys_[3] == "multisine")
+                {
+                        s = 1;
+                        segment = &trace_.multisine_;
+                }
+                else if (keys_[3] == "drop")
+                {
+                        s = 2;
+                        segment = &trace_.drop_;
+                }
+                else
+                        return;
+                if (depth_ != 4)
+                        return;
+
+                const auto & column = keys_[4];
+                auto response = column == "response";
+                if (column == "time")
+                        time_ = &first_time_[s];
+                else if (!response && column != "stimulation")
+                        return;
+                else if (sink_ && stimulation_)
+                        array_ = 2 * s + (response ? 1 : 0);
+                else
+                        target_ = response ?
+                                &segment->response_ :
+                                &segment->stimulation_;
+        }
+
+        const std::string & name_;
+        const Make & make_;
+        const Qsa::Recording::TraceHandler & handler_;
+        const Qsa::RecordingReader::Sink & sink_;
+        Qsa::Recording::Average * average_;
+        Qsa::Recording::Average ignored_average_;
+
+        Header header_;
+        std::shared_ptr<const Qsa::StimulationDescriptor> stimulation_;
+        int depth_ = 0;
+        std::string keys_[KEY_DEPTH];
+
+        // Destination of the numbers of the current array, if any
+        std::vector<double> * target_ = nullptr;
+        double * time_ = nullptr;
+        int array_ = -1; // to the sink
+
+        Qsa::Recording::Trace trace_;
+        std::size_t trace_index_ = 0;
+        std::vector<Pending> pending_;
+        double first_time_[3] = {};
+        bool time_seen_[3] = {};
+        std::vector<double> bins_;
+        std::vector<double> stimulation_real_;
+        std::vector<double> stimulation_imag_;
+        std::vector<double> response_real_;
+        std::vector<double> response_imag_;
+        double block_[BLOCK_SIZE];
+        std::size_t count_ = 0;
+};
+
+// JSON tokenizer driving a SAX handler. Numbers are converted by from_chars
+// straight from the input buffer, which is several times faster than the
+// lexer of nlohmann::json on documents made of long arrays of doubles.
+class Scanner
+{
+public:
+        Scanner(std::istream & input, const std::string & name)
+        :
+                input_(input),
+                name_(name),
+                buffer_(INPUT_BUFFER_SIZE)
+        {
+        }
+
+        void parse(nlohmann::json_sax<json> & sax)
+        {
+                std::vector<char> containers;
+                while (true)
+                {
+                        // Value
+                        skip_whitespace();
+                        auto c = peek();
+                        if (c == '{')
+                        {
+                                get();
+                                sax.start_object(-1);
+                                skip_whitespace();
+                                if (peek() == '}')
+                                {
+                                        get();
+                                        sax.end_object();
+                                }
+                                else
+                                {
+                                        containers.push_back('{');
+                                        read_key(sax);
+                                        continue;
+                                }
+                        }
+                        else if (c == '[')
+                        {
+                                get();
+                                sax.start_array(-1);
+                                skip_whitespace();
+                                if (peek() == ']')
+                                {
+                                        get();
+                                        sax.end_array();
+                                }
+                                else
+                                {
+                                        containers.push_back('[');
+                                        continue;
+                                }
+                        }
+                        else if (c == '"')
+                        {
+                                read_string();
+                                sax.string(string_);
+                        }
+                        else if (c == '-' || (c >= '0' && c <= '9'))
+                                read_number(sax);
+                        else if (c == 't')
+                        {
+                                expect("true");
+                                sax.boolean(true);
+                        }
+                        else if (c == 'f')
+                        {
+                                expect("false");
+                                sax.boolean(false);
+                        }
+                        else if (c == 'n')
+                        {
+                                expect("null");
+                                sax.null();
+                        }
+                        else
+                                fail("value expected");
+
+                        // Separators and ends of containers after the value
+                        while (true)
+                        {
+                                if (containers.empty())
+                                {
+                                        skip_whitespace();
+                                        if (peek() != EOF)
+                                                fail("end of input expected");
+                                        return;
+                                }
+                                skip_whitespace();
+                                c = get();
+                                auto container = containers.back();
+                                if (c == ',')
+                                {
+                                        if (container == '{')
+                                                read_key(sax);
+                                        break;
+                                }
+                                if (c == '}' && container == '{')
+                                        sax.end_object();
+                                else if (c == ']' && container == '[')
+                                        sax.end_array();
+                                else
+                                        fail("',' or end of container "
+                                                "expected");
+                                containers.pop_back();
+                        }
+                }
+        }
+
+private:
+        static const std::size_t INPUT_BUFFER_SIZE = 1 << 16;
+
+        [[noreturn]] void fail(const std::string & what)
+        {
+                throw std::runtime_error(
+                        name_ + ": " + what + " at byte " +
+                        std::to_string(offset_ + position_));
+        }
+
+        int peek()
+        {
+                if (position_ == size_ && !refill())
+                        return EOF;
+                return static_cast<unsigned char>(buffer_[position_]);
+        }
+
+        int get()
+        {
+                auto c = peek();
+                if (c != EOF)
+                        position_++;
+                return c;
+        }
+
+        bool refill()
+        {
+                offset_ += size_;
+                position_ = 0;
+                input_.read(buffer_.data(), buffer_.size());
+                size_ = input_.gcount();
+                return size_ > 0;
+        }
+
+        void skip_whitespace()
+        {
+                while (true)
+                {
+                        auto c = peek();
+                        if (c != ' ' && c != '\n' && c != '\r' && c != '\t')
+                                return;
+                        position_++;
+                }
+        }
+
+        void expect(const char * literal)
+        {
+                for (auto p = literal; *p != '\0'; p++)
+                {
+                        if (get() != *p)
+                                fail(std::string(literal) + " expected");
+                }
+        }
+
+        void read_key(nlohmann::json_sax<json> & sax)
+        {
+                skip_whitespace();
+                if (peek() != '"')
+                        fail("key expected");
+                read_string();
+                sax.key(string_);
+                skip_whitespace();
+                if (get() != ':')
+                        fail("':' expected");
+        }
+
+        void read_string()
+        {
+                get();
+                string_.clear();
+                while (true)
+                {
+                        auto c = get();
+                        if (c == '"')
+                                return;
+                        if (c == EOF || c < 0x20)
+                                fail("unterminated string");
+                        if (c != '\\')
+                        {
+                                string_ += static_cast<char>(c);
+                                continue;
+                        }
+                        c = get();
+                        switch (c)
+                        {
+                        case '"':
+                        case '\\':
+                        case '/':
+                                string_ += static_cast<char>(c);
+                                break;
+                        case 'b':
+                                string_ += '\b';
+                                break;
+                        case 'f':
+                                string_ += '\f';
+                                break;
+                        case 'n':
+                                string_ += '\n';
+                                break;
+                        case 'r':
+                                string_ += '\r';
+                                break;
+                        case 't':
+                                string_ += '\t';
+                                break;
+                        case 'u':
+                                read_code_point();
+                                break;
+                        default:
+                                fail("invalid escape");
+                        }
+                }
+        }
+
+        void read_code_point()
+        {
+                auto code = read_hex();
+                if (code >= 0xDC00 && code <= 0xDFFF)
+                        fail("unpaired surrogate");
+                if (code >= 0xD800 && code <= 0xDBFF)
+                {
+                        // High surrogate, the low one follows as an escape
+                        if (get() != '\\' || get() != 'u')
+                                fail("unpaired surrogate");
+                        auto low = read_hex();
+                        if (low < 0xDC00 || low > 0xDFFF)
+                                fail("unpaired surrogate");
+                        code = 0x10000 + ((code - 0xD800) << 10)
+                                + (low - 0xDC00);
+                }
+
+                // Encoded as UTF-8
+                if (code < 0x80)
+                        string_ += static_cast<char>(code);
+                else if (code < 0x800)
+                {
+                        string_ += static_cast<char>(0xC0 | (code >> 6));
+                        string_ += static_cast<char>(0x80 | (code & 0x3F));
+                }
+                else if (code < 0x10000)
+                {
+                        string_ += static_cast<char>(0xE0 | (code >> 12));
+                        string_ += static_cast<char>(
+                                0x80 | ((code >> 6) & 0x3F));
+                        string_ += static_cast<char>(0x80 | (code & 0x3F));
+                }
+                else
+                {
+                        string_ += static_cast<char>(0xF0 | (code >> 18));
+                        string_ += static_cast<char>(
+                                0x80 | ((code >> 12) & 0x3F));
+                        string_ += static_cast<char>(
+                                0x80 | ((code >> 6) & 0x3F));
+                        string_ += static_cast<char>(0x80 | (code & 0x3F));
+                }
+        }
+
+        // Four hexadecimal digits of an escaped code point
+        unsigned read_hex()
+        {
+                char digits[4];
+                for (auto & digit : digits)
+                        digit = static_cast<char>(get());
+                unsigned code = 0;
+                auto result = std::from_chars(digits, digits + 4, code, 16);
+                if (result.ptr != digits + 4)
+                        fail("invalid escape");
+                return code;
+        }
+
+        void read_number(nlohmann::json_sax<json> & sax)
+        {
+                // Copied out of the buffer, as it may span two reads
+                char text[64];
+                std::size_t size = 0;
+                auto integer = true;
+                while (true)
+                {
+                        auto c = peek();
+                        if (c == '.' || c == 'e' || c == 'E')
+                                integer = false;
+                        else if (c != '-' && c != '+' && (c < '0' || c > '9'))
+                                break;
+                        if (size == sizeof(text))
+                                fail("number too long");
+                        text[size++] = static_cast<char>(c);
+                        position_++;
+                }
+
+                auto end = text + size;
+                if (integer && text[0] == '-')
+                {
+                        std::int64_t value;
+                        auto result = std::from_chars(text, end, value);
+                        if (result.ptr == end && result.ec == std::errc())
+                        {
+                                sax.number_integer(value);
+                                return;
+                        }
+                }
+                else if (integer)
+                {
+                        std::uint64_t value;
+                        auto result = std::from_chars(text, end, value);
+                        if (result.ptr == end && result.ec == std::errc())
+                        {
+                                sax.number_unsigned(value);
+                                return;
+                        }
+                }
+                double value;
+                auto result = std::from_chars(text, end, value);
+                if (result.ptr != end ||
+                        (result.ec != std::errc() &&
+                         result.ec != std::errc::result_out_of_range))
+                        fail("invalid number");
+                sax.number_float(value, string_);
+        }
+
+        std::istream & input_;
+        const std::string & name_;
+        std::vector<char> buffer_;
+        std::size_t position_ = 0;
+        std::size_t size_ = 0;
+        std::size_t offset_ = 0;
+        std::string string_;
+};
+}
+
+namespace Qsa
+{
+RecordingReader::RecordingReader(const std::string & filename)
+:
+        filename_(filename)
+{
+}
+
+const std::string & RecordingReader::filename() const
+{
+        return filename_;
+}
+
+std::shared_ptr<const StimulationDescriptor> RecordingReader::read(
+        const Recording::TraceHandler & handler,
+        const Sink & sink,
+        Recording::Average * average) const
+{
+        Make make = [this](const Header & header)
+        {
+                auto number = [&](const std::string & key)
+                {
+                        auto it = header.numbers.find(key);
+                        if (it == header.numbers.end())
+                                throw std::runtime_error(
+                                        filename_ + ": missing " + key);
+                        return it->second;
+                };
+                auto array = [&](const std::string & key)
+                {
+                        auto it = header.arrays.find(key);
+                        if (it == header.arrays.end())
+                                throw std::runtime_error(
+                                        filename_ + ": missing " + key);
+                        return it->second;
+                };
+
+                // Recover generators from frequencies, which are k / duration
+                auto dt = number("dt");
+                auto duration = number("duration");
+                std::vector<int> generators;
+                for (auto frequency : array("frequencies"))
+                        generators.push_back(std::lround(frequency * duration));
+                auto intermodulation =
+                        Intermodulation::from_generators(generators);
+                Frequencies frequencies{intermodulation, dt, duration};
+                StimulationDescriptor stimulation{
+                        frequencies,
+                        array("amplitudes"),
+                        array("phases"),
+                        number("rest_level"),
+                        number("step_level"),
+                        number("step_delay"),
+                        number("drop_delay"),
+                        static_cast<int>(number("trace_count")),
+                        number("trace_pause"),
+                        static_cast<int>(number("trace_alternance"))};
+                return std::make_shared<StimulationDescriptor>(stimulation);
+        };
+
+        std::ifstream file(filename_, std::ios::binary);
+        if (!file)
+                throw std::runtime_error(filename_ + ": cannot open");
+        Handler parser(filename_, make, handler, sink, average);
+        Scanner(file, filename_).parse(parser);
+        return parser.finish();
+}
+}
@@ -0,0 +1,78 @@
+/*
+ * Quadratic Sinusoidal Analysis.
+ * Copyright (C) 2018 OpenQSA.
+ * 
+ * This file is part of OpenQSA.
+ * 
+ * OpenQSA is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ * 
+ * OpenQSA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with OpenQSA.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef QSA_RECORDINGREADER_H
+#define QSA_RECORDINGREADER_H
+
+#include "recording.h"
+#include "stimulationdescriptor.h"
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+
+namespace Qsa
+{
+// Reads recordings in the JSON format written by Recording::save, decoding
+// events of the parser straight into the vectors of a trace, which keep their
+// capacity from one trace to the next, without building any JSON document.
+// Samples may instead be handed to a sink, block by block, in which case the
+// traces only keep their start ticks and spectra. Averages, if any, are
+// read into the given structure. Keys may come in any order, traces before
+// the header being kept until it is complete.
+class RecordingReader
+{
+public:
+        enum Array
+        {
+                STEP_STIMULATION,
+                STEP_RESPONSE,
+                MULTISINE_STIMULATION,
+                MULTISINE_RESPONSE,
+                DROP_STIMULATION,
+                DROP_RESPONSE
+        };
+
+        using Sink = std::function<void(
+                std::size_t trace,
+                Array array,
+                const double * samples,
+                std::size_t count)>;
+
+        RecordingReader() = default;
+        RecordingReader(const RecordingReader &) = default;
+        RecordingReader & operator=(const RecordingReader &) = default;
+        ~RecordingReader() = default;
+
+        explicit RecordingReader(const std::string & filename);
+
+        const std::string & filename() const;
+        std::shared_ptr<const StimulationDescriptor> read(
+                const Recording::TraceHandler & handler,
+                const Sink & sink = {},
+                Recording::Average * average = nullptr) const;
+
+private:
+        std::string filename_;
+};
+}
+
+#endif /* QSA_RECORDINGREADER_H */
@@ -0,0 +1,96 @@
+/*
+ * Quadratic Sinusoidal Analysis.
+ * Copyright (C) 2018 OpenQSA.
+ * 
+ * This file is part of OpenQSA.
+ * 
+ * OpenQSA is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ * 
+ * OpenQSA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with OpenQSA.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "savetask.h"
+
+namespace Qsa
+{
+SaveTask::~SaveTask()
+{
+        // Let the file be completed rather than losing the recording
+        wait();
+}
+
+SaveTask::SaveTask(
+        std::shared_ptr<const Recording> recording,
+        const std::string & filename,
+        const Completion & completion)
+:
+        recording_(recording),
+        filename_(filename),
+        completion_(completion),
+        cancelled_(false),
+        finished_(false),
+        progress_(0.0),
+        saved_(false)
+{
+        // Thread is started last, once every member is initialized
+        thread_ = std::thread(&SaveTask::run, this);
+}
+
+void SaveTask::cancel()
+{
+        cancelled_ = true;
+}
+
+bool SaveTask::cancelled() const
+{
+        return cancelled_;
+}
+
+const std::string & SaveTask::filename() const
+{
+        return filename_;
+}
+
+bool SaveTask::finished() const
+{
+        return finished_;
+}
+
+double SaveTask::progress() const
+{
+        return progress_;
+}
+
+bool SaveTask::saved() const
+{
+        return saved_;
+}
+
+void SaveTask::wait()
+{
+        if (thread_.joinable())
+                thread_.join();
+}
+
+void SaveTask::run()
+{
+        auto progress = [this](double fraction)
+        {
+                progress_ = fraction;
+                return !cancelled_;
+        };
+        saved_ = recording_->save(filename_, progress);
+        finished_ = true;
+        if (completion_)
+                completion_(saved_);
+}
+}
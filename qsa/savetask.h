@@ -0,0 +1,73 @@
+/*
+ * Quadratic Sinusoidal Analysis.
+ * Copyright (C) 2018 OpenQSA.
+ * 
+ * This file is part of OpenQSA.
+ * 
+ * OpenQSA is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ * 
+ * OpenQSA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with OpenQSA.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef QSA_SAVETASK_H
+#define QSA_SAVETASK_H
+
+#include "recording.h"
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+
+namespace Qsa
+{
+// Writes a recording to disk on a background thread. The recording is shared,
+// so the recorder can start the next one while the file is being written.
+class SaveTask
+{
+public:
+        // Called from the background thread once the task is over
+        using Completion = std::function<void(bool saved)>;
+
+        SaveTask(const SaveTask &) = delete;
+        SaveTask & operator=(const SaveTask &) = delete;
+        ~SaveTask();
+
+        explicit SaveTask(
+                std::shared_ptr<const Recording> recording,
+                const std::string & filename,
+                const Completion & completion = {});
+
+        void cancel();
+        bool cancelled() const;
+        const std::string & filename() const;
+        bool finished() const;
+        double progress() const;
+        bool saved() const;
+        void wait();
+
+private:
+        void run();
+
+        std::shared_ptr<const Recording> recording_;
+        std::string filename_;
+        Completion completion_;
+        std::atomic<bool> cancelled_;
+        std::atomic<bool> finished_;
+        std::atomic<double> progress_;
+        std::atomic<bool> saved_;
+        std::thread thread_;
+};
+}
+
+#endif /* QSA_SAVETASK_H */
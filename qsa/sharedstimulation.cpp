@@ -0,0 +1,247 @@
+/*
+ * Quadratic Sinusoidal Analysis.
+ * Copyright (C) 2018 OpenQSA.
+ * 
+ * This file is part of OpenQSA.
+ * 
+ * OpenQSA is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ * 
+ * OpenQSA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with OpenQSA.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "sharedstimulation.h"
+
+#include "stimulationconverter.h"
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+// Segment layout: header, encoded descriptor, then waveform (8-byte aligned)
+struct Header
+{
+        // Odd while a publication is being written
+        std::atomic<std::uint64_t> sequence;
+        std::uint64_t generation;
+        std::uint64_t text_size;
+        std::uint64_t waveform_size;
+};
+
+static_assert(
+        std::atomic<std::uint64_t>::is_always_lock_free,
+        "sequence lock must not rely on a process-local lock");
+
+std::size_t waveform_offset(std::size_t text_size)
+{
+        auto offset = sizeof(Header) + text_size;
+        return (offset + sizeof(double) - 1) / sizeof(double) * sizeof(double);
+}
+
+std::runtime_error system_error(const std::string & name, const char * what)
+{
+        return std::runtime_error(
+                name + ": " + what + ", " + std::strerror(errno));
+}
+}
+
+namespace Qsa
+{
+const char * const SharedStimulation::DEFAULT_NAME = "/qsa_stimulation";
+
+SharedStimulation::~SharedStimulation()
+{
+        // The segment itself outlives both modules, so that either one can
+        // be reloaded without losing the stimulation
+        unmap();
+        if (fd_ >= 0)
+                close(fd_);
+}
+
+SharedStimulation::SharedStimulation(const std::string & name)
+:
+        name_(name),
+        fd_(-1),
+        address_(nullptr),
+        size_(0),
+        generation_(0),
+        sequence_(0),
+        waveform_(nullptr),
+        waveform_size_(0)
+{
+}
+
+std::string SharedStimulation::channel_name(int channel)
+{
+        if (channel == 0)
+                return DEFAULT_NAME;
+        return DEFAULT_NAME + std::string("_") + std::to_string(channel);
+}
+
+bool SharedStimulation::fetch(StimulationDescriptor & descriptor)
+{
+        if (fd_ < 0)
+        {
+                // Nothing published yet, maybe later
+                fd_ = shm_open(name_.c_str(), O_RDONLY, 0);
+                if (fd_ < 0)
+                        return false;
+        }
+        if (!map(false, sizeof(Header)))
+                return false;
+        auto header = static_cast<const Header *>(address_);
+        auto sequence = header->sequence.load(std::memory_order_acquire);
+        if (sequence % 2 != 0 || header->generation == generation_)
+                return false;
+
+        // Publication may have grown the segment since it was mapped
+        auto generation = header->generation;
+        std::size_t text_size = header->text_size;
+        std::size_t waveform_size = header->waveform_size;
+        auto size = waveform_offset(text_size)
+                + waveform_size * sizeof(double);
+        if (!map(false, size))
+                return false;
+        header = static_cast<const Header *>(address_);
+        auto bytes = static_cast<const char *>(address_);
+        std::string text(bytes + sizeof(Header), text_size);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (header->sequence.load(std::memory_order_relaxed) != sequence)
+                return false; // Written meanwhile, next poll will tell
+
+        descriptor = StimulationConverter::parse(text);
+        generation_ = generation;
+        sequence_ = sequence;
+        waveform_ = reinterpret_cast<const double *>(
+                bytes + waveform_offset(text_size));
+        waveform_size_ = waveform_size;
+        return true;
+}
+
+std::uint64_t SharedStimulation::generation() const
+{
+        return generation_;
+}
+
+const std::string & SharedStimulation::name() const
+{
+        return name_;
+}
+
+void SharedStimulation::publish(const Stimulation & stimulation)
+{
+        if (fd_ < 0)
+        {
+                fd_ = shm_open(name_.c_str(), O_RDWR | O_CREAT, 0644);
+                if (fd_ < 0)
+                        throw system_error(name_, "cannot open");
+        }
+        auto text = StimulationConverter::print(stimulation);
+        const auto & waveform = stimulation.waveform();
+        auto offset = waveform_offset(text.size());
+        if (!map(true, offset + waveform.size() * sizeof(double)))
+                throw system_error(name_, "cannot map");
+
+        // Generations carry on from a previous publisher
+        auto header = static_cast<Header *>(address_);
+        auto sequence = header->sequence.load(std::memory_order_relaxed);
+        header->sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        auto bytes = static_cast<char *>(address_);
+        std::memcpy(bytes + sizeof(Header), text.data(), text.size());
+        std::memcpy(
+                bytes + offset,
+                waveform.data(),
+                waveform.size() * sizeof(double));
+        header->text_size = text.size();
+        header->waveform_size = waveform.size();
+        header->generation++;
+        header->sequence.store(sequence + 2, std::memory_order_release);
+        generation_ = header->generation;
+        sequence_ = sequence + 2;
+        waveform_ = reinterpret_cast<const double *>(bytes + offset);
+        waveform_size_ = waveform.size();
+}
+
+const double * SharedStimulation::waveform() const
+{
+        return waveform_;
+}
+
+std::size_t SharedStimulation::waveform_size() const
+{
+        return waveform_size_;
+}
+
+bool SharedStimulation::waveform_valid() const
+{
+        if (waveform_ == nullptr)
+                return false;
+        // Samples read before are ordered before this load
+        std::atomic_thread_fence(std::memory_order_acquire);
+        auto header = static_cast<const Header *>(address_);
+        return header->sequence.load(std::memory_order_relaxed) == sequence_;
+}
+
+bool SharedStimulation::map(bool writable, std::size_t size)
+{
+        if (address_ != nullptr && size <= size_)
+                return true;
+        struct stat status;
+        if (fstat(fd_, &status) < 0)
+                return false;
+        auto available = static_cast<std::size_t>(status.st_size);
+        if (available < size)
+        {
+                // Only the publisher resizes, readers wait for it
+                if (!writable || ftruncate(fd_, size) < 0)
+                        return false;
+                available = size;
+        }
+        // Keep the waveform fetched last in view
+        auto waveform = waveform_ == nullptr ? 0 :
+                reinterpret_cast<const char *>(waveform_)
+                - static_cast<const char *>(address_);
+        unmap();
+        auto protection = writable ? PROT_READ | PROT_WRITE : PROT_READ;
+        auto address = mmap(
+                nullptr,
+                available,
+                protection,
+                MAP_SHARED,
+                fd_,
+                0);
+        if (address == MAP_FAILED)
+                return false;
+        address_ = address;
+        size_ = available;
+        if (waveform_size_ > 0)
+                waveform_ = reinterpret_cast<const double *>(
+                        static_cast<const char *>(address_) + waveform);
+        return true;
+}
+
+void SharedStimulation::unmap()
+{
+        if (address_ != nullptr)
+                munmap(address_, size_);
+        address_ = nullptr;
+        size_ = 0;
+}
+}
@@ -0,0 +1,84 @@
+/*
+ * Quadratic Sinusoidal Analysis.
+ * Copyright (C) 2018 OpenQSA.
+ * 
+ * This file is part of OpenQSA.
+ * 
+ * OpenQSA is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ * 
+ * OpenQSA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with OpenQSA.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef QSA_SHAREDSTIMULATION_H
+#define QSA_SHAREDSTIMULATION_H
+
+#include "stimulation.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace Qsa
+{
+// Stimulation handed from QsaStimulation to QsaResponse through a named POSIX
+// shared memory segment, holding the encoded descriptor and the synthesized
+// waveform. The publishing side maps it read-write, the other side read-only
+// and polls the generation counter, bumped by each publication. A sequence
+// lock keeps readers from picking up a half-written stimulation.
+class SharedStimulation
+{
+public:
+        static const char * const DEFAULT_NAME;
+
+        SharedStimulation(const SharedStimulation &) = delete;
+        SharedStimulation & operator=(const SharedStimulation &) = delete;
+        ~SharedStimulation();
+
+        explicit SharedStimulation(const std::string & name = DEFAULT_NAME);
+
+        // Segment of a given channel, so that several stimulations can be
+        // shared at once, channel 0 being DEFAULT_NAME
+        static std::string channel_name(int channel);
+
+        // Reading side: true when a stimulation newer than the last one
+        // fetched was published, which is then copied to descriptor
+        bool fetch(StimulationDescriptor & descriptor);
+        // Generation last published or fetched, 0 for none
+        std::uint64_t generation() const;
+        const std::string & name() const;
+        // Publishing side: the segment grows as needed, never shrinks, so
+        // that readers keep a valid mapping
+        void publish(const Stimulation & stimulation);
+        // Samples of the last stimulation fetched, in place in the segment,
+        // never copied. The next publication overwrites them: samples read
+        // are only to be trusted if waveform_valid() still holds afterwards.
+        const double * waveform() const;
+        std::size_t waveform_size() const;
+        // False once a publication started after the last fetch
+        bool waveform_valid() const;
+
+private:
+        bool map(bool writable, std::size_t size);
+        void unmap();
+
+        std::string name_;
+        int fd_;
+        void * address_;
+        std::size_t size_;
+        std::uint64_t generation_;
+        std::uint64_t sequence_; // of the last stimulation fetched
+        const double * waveform_;
+        std::size_t waveform_size_;
+};
+}
+
+#endif /* QSA_SHAREDSTIMULATION_H */
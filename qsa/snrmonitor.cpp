@@ -0,0 +1,198 @@
+/*
+ * Quadratic Sinusoidal Analysis.
+ * Copyright (C) 2018 OpenQSA.
+ * 
+ * This file is part of OpenQSA.
+ * 
+ * OpenQSA is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ * 
+ * OpenQSA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with OpenQSA.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "snrmonitor.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <set>
+
+namespace
+{
+// Noise bins looked for on each side of an excited bin, and how far
+const int NOISE_BINS_PER_SIDE = 2;
+const int NOISE_SPAN = 8;
+
+// Radius of the 95% confidence disc of a complex mean, in standard errors
+// (the squared modulus of a circular gaussian error is exponential)
+const double WIDTH_FACTOR = std::sqrt(-std::log(0.05));
+}
+
+namespace Qsa
+{
+SnrMonitor::SnrMonitor()
+:
+        count_(0),
+        paired_(false),
+        target_snr_(0),
+        target_width_(0)
+{
+}
+
+SnrMonitor::SnrMonitor(const StimulationDescriptor & stimulation)
+:
+        SnrMonitor()
+{
+        const auto & frequencies = stimulation.frequencies();
+        const auto & intermodulation = frequencies.intermodulation();
+        const auto & generators = intermodulation.generators();
+        const auto & products = intermodulation.products();
+        auto period = std::lround(frequencies.duration() / frequencies.dt());
+        paired_ = stimulation.trace_alternance() < 0;
+
+        // Products include generators, no excited bin is at DC
+        std::set<int> excited(generators.begin(), generators.end());
+        excited.insert(products.begin(), products.end());
+        std::vector<std::vector<int>> neighbours;
+        std::set<int> bins(excited);
+        for (auto k : excited)
+        {
+                neighbours.emplace_back();
+                for (auto direction : {-1, +1})
+                {
+                        auto found = 0;
+                        for (auto d = 1; d <= NOISE_SPAN; d++)
+                        {
+                                auto n = k + direction * d;
+                                if (n <= 0 || 2 * n >= period)
+                                        break;
+                                if (excited.count(n))
+                                        continue;
+                                neighbours.back().push_back(n);
+                                bins.insert(n);
+                                if (++found == NOISE_BINS_PER_SIDE)
+                                        break;
+                        }
+                }
+        }
+
+        bins_.assign(bins.begin(), bins.end());
+        power_.resize(bins_.size());
+        auto index = [&](int bin)
+        {
+                return std::lower_bound(bins_.begin(), bins_.end(), bin) -
+                        bins_.begin();
+        };
+        auto i = 0;
+        for (auto k : excited)
+        {
+                Excited item{};
+                item.index_ = index(k);
+                item.linear_ = generators.count(k) > 0;
+                for (auto n : neighbours[i++])
+                        item.neighbours_.push_back(index(n));
+                excited_.push_back(item);
+        }
+}
+
+void SnrMonitor::add(
+        const std::vector<std::complex<double>> & response,
+        int sign)
+{
+        if (response.size() != bins_.size())
+                return;
+        for (std::size_t i = 0; i < bins_.size(); i++)
+                power_[i] += std::norm(response[i]);
+
+        // Quadratic responses do not change sign with the stimulation
+        for (auto & excited : excited_)
+        {
+                auto value = response[excited.index_];
+                excited.sum_ += excited.linear_ ? double(sign) * value : value;
+        }
+        count_++;
+}
+
+const std::vector<int> & SnrMonitor::bins() const
+{
+        return bins_;
+}
+
+std::size_t SnrMonitor::count() const
+{
+        return count_;
+}
+
+double SnrMonitor::max_width() const
+{
+        auto result = 0.0;
+        for (const auto & excited : excited_)
+                result = std::max(
+                        result,
+                        WIDTH_FACTOR * standard_error(excited));
+        return count_ > 0 ? result : std::numeric_limits<double>::infinity();
+}
+
+double SnrMonitor::min_snr() const
+{
+        if (count_ == 0)
+                return 0;
+        auto result = std::numeric_limits<double>::infinity();
+        for (const auto & excited : excited_)
+        {
+                auto mean = std::abs(excited.sum_) / double(count_);
+                result = std::min(result, mean / standard_error(excited));
+        }
+        return result;
+}
+
+bool SnrMonitor::satisfied() const
+{
+        if (count_ < 2 || (paired_ && count_ % 2 != 0))
+                return false;
+        if (target_snr_ <= 0 && target_width_ <= 0)
+                return false;
+        for (const auto & excited : excited_)
+        {
+                auto error = standard_error(excited);
+                auto mean = std::abs(excited.sum_) / double(count_);
+                auto snr_reached = target_snr_ > 0 &&
+                        mean >= target_snr_ * error;
+                auto width_reached = target_width_ > 0 &&
+                        WIDTH_FACTOR * error <= target_width_;
+                if (!snr_reached && !width_reached)
+                        return false;
+        }
+        return true;
+}
+
+void SnrMonitor::set_target_snr(double target_snr)
+{
+        target_snr_ = target_snr;
+}
+
+void SnrMonitor::set_target_width(double target_width)
+{
+        target_width_ = target_width;
+}
+
+double SnrMonitor::standard_error(const Excited & excited) const
+{
+        // Noise power per trace, averaged over neighbours, then over traces
+        if (excited.neighbours_.empty() || count_ == 0)
+                return std::numeric_limits<double>::infinity();
+        auto power = 0.0;
+        for (auto n : excited.neighbours_)
+                power += power_[n];
+        power /= double(excited.neighbours_.size()) * count_;
+        return std::sqrt(power / double(count_));
+}
+}
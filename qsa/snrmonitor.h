@@ -0,0 +1,80 @@
+/*
+ * Quadratic Sinusoidal Analysis.
+ * Copyright (C) 2018 OpenQSA.
+ * 
+ * This file is part of OpenQSA.
+ * 
+ * OpenQSA is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ * 
+ * OpenQSA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with OpenQSA.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef QSA_SNRMONITOR_H
+#define QSA_SNRMONITOR_H
+
+#include "stimulationdescriptor.h"
+
+#include <complex>
+#include <cstddef>
+#include <vector>
+
+namespace Qsa
+{
+// Follows, trace after trace, the average response at every generator and
+// product together with the noise floor measured at neighbouring bins that
+// are not excited. The noise floor gives the standard error of each average,
+// hence its signal to noise ratio and the radius of its 95% confidence disc.
+// Linear responses are sign-corrected for alternating traces.
+class SnrMonitor
+{
+public:
+        SnrMonitor();
+        SnrMonitor(const SnrMonitor &) = default;
+        SnrMonitor & operator=(const SnrMonitor &) = default;
+        ~SnrMonitor() = default;
+
+        explicit SnrMonitor(const StimulationDescriptor & stimulation);
+
+        // Response coefficients of one trace at bins(), see FourierAccumulator
+        void add(const std::vector<std::complex<double>> & response, int sign);
+        const std::vector<int> & bins() const; // excited and noise bins
+        std::size_t count() const;
+        double max_width() const;
+        double min_snr() const;
+        // True once every excited bin reaches a target, traces being paired
+        // when their sign alternates
+        bool satisfied() const;
+        void set_target_snr(double target_snr);
+        void set_target_width(double target_width);
+
+private:
+        struct Excited
+        {
+                std::size_t index_; // in bins_
+                bool linear_;
+                std::vector<std::size_t> neighbours_; // noise bins, in bins_
+                std::complex<double> sum_;
+        };
+
+        double standard_error(const Excited & excited) const;
+
+        std::vector<int> bins_;
+        std::vector<Excited> excited_;
+        std::vector<double> power_; // sum of squared moduli, per bin
+        std::size_t count_;
+        bool paired_;
+        double target_snr_;
+        double target_width_;
+};
+}
+
+#endif /* QSA_SNRMONITOR_H */
@@ -20,55 +20,127 @@
 
 #include "stimulation.h"
 
+#include "fft.h"
+#include "stimulationconverter.h"
+
+#include <algorithm>
 #include <cmath>
-#include <iomanip>
-#include <limits>
-#include <sstream>
+#include <complex>
+#include <map>
+#include <mutex>
+#include <string>
 
-namespace Qsa
-{
-const std::vector<double> & Stimulation::amplitudes() const
+namespace
 {
-        return amplitudes_;
+// Waveform of a stimulation not synthesized yet
+const std::vector<double> NO_SAMPLES;
+
+// Samples summed between progress reports
+const std::size_t PROGRESS_STEP = 4096;
 }
 
+namespace Qsa
+{
+
 void Stimulation::apply()
 {
         // Start stimulation
         // (it will stop automatically when finished)
+        if (!waveform_)
+                precompute();
         applying_ = true;
+        stop_requested_ = false;
+        stop_at_ = waveform_->output.size();
+        settle_requested_ = false;
+        skip_ = 0;
+        skip_at_ = 0;
+        skip_size_ = 0;
+        measure_begin_ = 0;
+        measure_end_ = 0;
 }
 
-double Stimulation::drop_delay() const
+std::vector<WaveformPyramid::Bucket> Stimulation::envelope(
+        std::size_t begin,
+        std::size_t end,
+        std::size_t count) const
 {
-        return drop_delay_;
+        if (!waveform_)
+                return {};
+        return waveform_->pyramid.envelope(
+                waveform_->output,
+                begin,
+                end,
+                count);
 }
 
 void Stimulation::evaluate(double t, double & output, int & sync) const
 {
-        if (!applying_)
+        evaluate_tick(static_cast<long>(t / frequencies_.dt()), output, sync);
+}
+
+void Stimulation::evaluate_tick(long tick, double & output, int & sync) const
+{
+        std::size_t index;
+        output = advance(tick, index, sync) ?
+                waveform_->output[index] :
+                rest_level_;
+}
+
+bool Stimulation::advance(long tick, std::size_t & index, int & sync) const
+{
+        if (!applying_ || tick < 0)
         {
-                output = rest_level_;
                 sync = SYNC_OFF;
-                return;
+                return false;
+        }
+        // Waveform index, ahead of time once settling periods were shortened
+        index = static_cast<std::size_t>(tick) + skip_;
+        if (skip_size_ > 0 && index >= skip_at_)
+        {
+                index += skip_size_;
+                skip_ += skip_size_;
+                skip_size_ = 0;
+        }
+        auto trace_size = trace_count_ > 0 ?
+                waveform_->output.size() / trace_count_ :
+                0;
+        if (settle_requested_ && trace_size > 0)
+        {
+                // Traces all have the same length, as their segments
+                auto step_size = static_cast<std::size_t>(
+                        step_delay_ / frequencies_.dt());
+                auto period = static_cast<std::size_t>(
+                        2 * frequencies_.duration() / frequencies_.dt()) / 2;
+                auto start = index - index % trace_size + step_size;
+                if (index > start && index < start + period)
+                {
+                        // The multisine is periodic: measure the period
+                        // starting now, then skip what is left of the one
+                        // that was planned
+                        measure_begin_ = index;
+                        measure_end_ = start + period;
+                        skip_at_ = index + period;
+                        skip_size_ = start + 2 * period - skip_at_;
+                }
+                settle_requested_ = false;
         }
-        auto iterations = static_cast<std::size_t>(t / frequencies_.dt());
-        if (iterations < computed_output_.size())
+        if (stop_requested_ && trace_size > 0)
         {
-                output = computed_output_[iterations];
-                sync = computed_sync_[iterations];
+                // End the current trace
+                auto end = (index / trace_size + 1) * trace_size;
+                stop_at_ = std::min(stop_at_, end);
+                stop_requested_ = false;
         }
-        else
+        if (index >= stop_at_)
         {
                 applying_ = false;
-                output = rest_level_;
                 sync = SYNC_OFF;
+                return false;
         }
-}
-
-const Frequencies & Stimulation::frequencies() const
-{
-        return frequencies_;
+        sync = index >= measure_begin_ && index < measure_end_ ?
+                SYNC_MULTISINE :
+                waveform_->sync[index];
+        return true;
 }
 
 bool Stimulation::is_applying() const
@@ -76,172 +148,230 @@ bool Stimulation::is_applying() const
         return applying_;
 }
 
-const std::vector<double> & Stimulation::phases() const
-{
-        return phases_;
-}
-
-double Stimulation::rest_level() const
-{
-        return rest_level_;
-}
-
-double Stimulation::step_delay() const
-{
-        return step_delay_;
-}
-
-double Stimulation::step_level() const
+void Stimulation::request_stop()
 {
-        return step_level_;
+        stop_requested_ = applying_;
 }
 
-std::string Stimulation::to_string() const
+void Stimulation::settle()
 {
-        std::stringstream ss;
-        ss << std::setprecision(std::numeric_limits<double>::digits10 + 1);
-        ss << "Dt (s): " << frequencies_.dt() << std::endl;
-        ss << "Duration (s): " << frequencies_.duration() << std::endl;
-        ss << "Frequencies (Hz):";
-        for (auto fundamental : frequencies_.fundamentals())
-                ss << " " << fundamental;
-        ss << std::endl;
-        ss << "Amplitudes:";
-        for (auto amplitude : amplitudes_)
-                ss << " " << amplitude;
-        ss << std::endl;
-        ss << "Phases:";
-        for (auto phase : phases_)
-                ss << " " << phase;
-        ss << std::endl;
-        ss << "Rest level: " << rest_level_ << std::endl;
-        ss << "Step level: " << step_level_ << std::endl;
-        ss << "Step delay (s): " << step_delay_ << std::endl;
-        ss << "Trace count: " << trace_count_ << std::endl;
-        ss << "Trace pause: " << trace_pause_ << std::endl;
-        ss << "Trace alternance: " << trace_alternance_ << std::endl;
-        return ss.str();
+        settle_requested_ = applying_;
 }
 
-int Stimulation::trace_alternance() const
+const std::vector<double> & Stimulation::waveform() const
 {
-        return trace_alternance_;
+        return waveform_ ? waveform_->output : NO_SAMPLES;
 }
 
-int Stimulation::trace_count() const
-{
-        return trace_count_;
-}
-
-double Stimulation::trace_pause() const
-{
-        return trace_pause_;
-}
-
-Stimulation::Stimulation(
-        const Frequencies & frequencies,
-        const std::vector<double> & amplitudes,
-        const std::vector<double> & phases,
-        double rest_level,
-        double step_level,
-        double step_delay,
-        double drop_delay,
-        int trace_count,
-        double trace_pause,
-        int trace_alternance)
+Stimulation::Stimulation(const StimulationDescriptor & descriptor)
 :
-        frequencies_(frequencies),
-        amplitudes_(amplitudes),
-        phases_(phases),
-        rest_level_(rest_level),
-        step_level_(step_level),
-        step_delay_(step_delay),
-        drop_delay_(drop_delay),
-        trace_count_(trace_count),
-        trace_pause_(trace_pause),
-        trace_alternance_(trace_alternance),
-        applying_(false)
+        StimulationDescriptor(descriptor)
 {
-        precompute();
+        // Waveform is computed by the builder, or on the first apply()
 }
 
-void Stimulation::precompute()
+bool Stimulation::precompute(const Progress & progress)
 {
+        // Waveforms in use, by encoded parameters
+        static std::mutex cache_mutex;
+        static std::map<std::string, std::weak_ptr<const Waveform>> cache;
+        auto key = StimulationConverter::print(*this);
+        {
+                std::lock_guard<std::mutex> lock(cache_mutex);
+                auto found = cache.find(key);
+                if (found != cache.end())
+                        waveform_ = found->second.lock();
+                if (waveform_)
+                        return true;
+        }
+
+        auto waveform = std::make_shared<Waveform>();
+        auto & computed_output = waveform->output;
+        auto & computed_sync = waveform->sync;
         auto to_ticks = [&](double period)
         {
                 return static_cast<std::size_t>(period / frequencies_.dt());
         };
+        auto multisine_size = to_ticks(2 * frequencies_.duration());
+
+        // The multisine first, then traces, each reported as one half
+        auto cancelled = false;
+        auto report = [&](double fraction)
+        {
+                cancelled = cancelled || (progress && !progress(fraction));
+                return !cancelled;
+        };
+        auto multisine = synthesize(
+                multisine_size,
+                [&](double fraction)
+                {
+                        return report(fraction / 2);
+                });
+        if (cancelled)
+                return false;
         for (auto i = 0; i < trace_count_; i++)
         {
+                if (!report(0.5 + 0.5 * i / trace_count_))
+                        return false;
+
                 // Step (pre)
                 auto step_size = to_ticks(step_delay_);
                 std::fill_n(
-                        std::back_inserter(computed_output_),
+                        std::back_inserter(computed_output),
                         step_size,
                         step_level_);
                 std::fill_n(
-                        std::back_inserter(computed_sync_),
+                        std::back_inserter(computed_sync),
                         step_size, SYNC_STEP);
 
                 // Multisine (twice duration)
-                auto n = frequencies_.fundamentals().size();
                 auto sign = trace_alternance_ < 0 && i % 2 != 0 ? -1 : +1;
-                auto multisine_size = to_ticks(2 * frequencies_.duration());
-                auto sine_function = [&](double t, int k)
-                {
-                        auto ak = amplitudes_[k];
-                        auto fk = frequencies_.fundamentals()[k];
-                        auto pk = phases_[k];
-                        return ak * sin(2 * M_PI * fk * t + pk) / n;
-                };
-                auto multisine_function = [&](double t)
-                {
-                        auto sum = step_level_;
-                        for (auto k = 0U; k < n; k++)
-                                sum += sign * sine_function(t, k);
-                        return sum;
-                };
                 for (auto j = 0U; j < multisine_size; j++)
                 {
-                        auto t = j * frequencies_.dt();
-                        auto output = multisine_function(t);
+                        auto output = step_level_ + sign * multisine[j];
                         auto sync = j < multisine_size / 2 ?
                                 SYNC_IGNORE : SYNC_MULTISINE;
-                        computed_output_.push_back(output);
-                        computed_sync_.push_back(sync);
+                        computed_output.push_back(output);
+                        computed_sync.push_back(sync);
                 }
 
                 // Step (post)
                 std::fill_n(
-                        std::back_inserter(computed_output_),
+                        std::back_inserter(computed_output),
                         step_size,
                         step_level_);
                 std::fill_n(
-                        std::back_inserter(computed_sync_),
+                        std::back_inserter(computed_sync),
                         step_size,
                         SYNC_IGNORE);
 
                 // Drop
                 auto drop_size = to_ticks(drop_delay_);
                 std::fill_n(
-                        std::back_inserter(computed_output_),
+                        std::back_inserter(computed_output),
                         drop_size,
                         rest_level_);
                 std::fill_n(
-                        std::back_inserter(computed_sync_),
+                        std::back_inserter(computed_sync),
                         drop_size,
                         SYNC_DROP);
 
                 // Pause
                 auto pause_size = to_ticks(trace_pause_);
                 std::fill_n(
-                        std::back_inserter(computed_output_),
+                        std::back_inserter(computed_output),
                         pause_size,
                         rest_level_);
                 std::fill_n(
-                        std::back_inserter(computed_sync_),
+                        std::back_inserter(computed_sync),
                         pause_size,
                         SYNC_IGNORE);
         }
+
+        waveform->pyramid = WaveformPyramid(computed_output);
+
+        // Unless the same one was synthesized meanwhile
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        auto & entry = cache[key];
+        waveform_ = entry.lock();
+        if (!waveform_)
+        {
+                entry = waveform;
+                waveform_ = waveform;
+        }
+        for (auto i = cache.begin(); i != cache.end();)
+                i = i->second.expired() ? cache.erase(i) : std::next(i);
+        return true;
+}
+
+void Stimulation::resume(const Stimulation & previous, long tick)
+{
+        if (!waveform_)
+                precompute();
+        auto ratio = previous.frequencies_.dt() / frequencies_.dt();
+        auto rescale = [ratio](std::size_t index)
+        {
+                return static_cast<std::size_t>(std::lround(index * ratio));
+        };
+        applying_ = previous.applying_;
+        stop_requested_ = previous.stop_requested_;
+        settle_requested_ = previous.settle_requested_;
+        skip_at_ = rescale(previous.skip_at_);
+        skip_size_ = rescale(previous.skip_size_);
+        measure_begin_ = rescale(previous.measure_begin_);
+        measure_end_ = rescale(previous.measure_end_);
+
+        // Traces end on the same tick, whatever the rounding of segments
+        auto previous_size = previous.waveform().size();
+        auto size = waveform_->output.size();
+        stop_at_ = rescale(previous.stop_at_);
+        if (trace_count_ > 0 && previous_size > 0 && size > 0)
+        {
+                auto previous_trace = previous_size / trace_count_;
+                if (previous.stop_at_ % previous_trace == 0)
+                {
+                        auto traces = previous.stop_at_ / previous_trace;
+                        stop_at_ = traces * (size / trace_count_);
+                }
+        }
+
+        // Index of the sample at tick, with unsigned (modular) arithmetic
+        auto position = static_cast<std::size_t>(tick) + previous.skip_;
+        skip_ = rescale(position) - static_cast<std::size_t>(tick);
+}
+
+std::vector<double> Stimulation::synthesize(
+        std::size_t size,
+        const Progress & progress) const
+{
+        auto n = frequencies_.fundamentals().size();
+        auto dt = frequencies_.dt();
+        auto duration = frequencies_.duration();
+        auto period = std::lround(duration / dt);
+        std::vector<double> result(size);
+        if (n == 0)
+                return result;
+
+        // Whole number of ticks per period: synthesize one period by inverse
+        // FFT of the multisine spectrum, then repeat it
+        const auto & generators = frequencies_.intermodulation().generators();
+        auto periodic =
+                period > 0
+                && std::abs(duration / dt - period) < 1e-9 * period
+                && *generators.rbegin() < period / 2;
+        if (periodic)
+        {
+                // a sin(2 pi k j / N + p) holds a exp(i (p - pi / 2)) / 2 at k
+                std::vector<std::complex<double>> spectrum(period / 2 + 1);
+                auto k = 0U;
+                for (auto generator : generators)
+                {
+                        spectrum[generator] = std::polar(
+                                amplitudes_[k] / n / 2,
+                                phases_[k] - M_PI / 2);
+                        k++;
+                }
+                std::vector<double> waveform(period);
+                Fft(period).inverse_real(spectrum.data(), waveform.data());
+                for (std::size_t j = 0; j < size; j++)
+                        result[j] = waveform[j % period];
+                return result;
+        }
+
+        // Otherwise sum sines sample by sample
+        for (std::size_t j = 0; j < size; j++)
+        {
+                if (j % PROGRESS_STEP == 0 && !progress(double(j) / size))
+                        return {};
+                auto t = j * dt;
+                for (auto k = 0U; k < n; k++)
+                {
+                        auto ak = amplitudes_[k];
+                        auto fk = frequencies_.fundamentals()[k];
+                        auto pk = phases_[k];
+                        result[j] += ak * sin(2 * M_PI * fk * t + pk) / n;
+                }
+        }
+        return result;
 }
 }
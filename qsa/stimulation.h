@@ -21,14 +21,20 @@
 #ifndef QSA_STIMULATION_H
 #define QSA_STIMULATION_H
 
-#include "frequencies.h"
+#include "stimulationdescriptor.h"
+#include "waveformpyramid.h"
 
-#include <string>
+#include <cstddef>
+#include <functional>
+#include <memory>
 #include <vector>
 
 namespace Qsa
 {
-class Stimulation
+// Stimulation that can be applied, its waveform being synthesized once for
+// all traces, before the first trace at the latest. Stimulations with the
+// same parameters share one waveform, even when built independently.
+class Stimulation : public StimulationDescriptor
 {
 public:
         enum Sync
@@ -40,58 +46,69 @@ public:
                 SYNC_DROP = 4
         };
 
+        // Called with the fraction synthesized, returns false to abort
+        using Progress = std::function<bool(double)>;
+
         Stimulation() = default;
         Stimulation(const Stimulation &) = default;
         Stimulation & operator=(const Stimulation &) = default;
         ~Stimulation() = default;
 
-        const std::vector<double> & amplitudes() const;
+        explicit Stimulation(const StimulationDescriptor & descriptor);
+
         void apply();
-        double drop_delay() const;
+        // Samples [begin, end) of the waveform in count buckets, drawn in
+        // time linear in count whatever the range
+        std::vector<WaveformPyramid::Bucket> envelope(
+                std::size_t begin,
+                std::size_t end,
+                std::size_t count) const;
         void evaluate(double t, double & output, int & sync) const;
-        const Frequencies & frequencies() const;
+        // Same as evaluate() at tick * dt, without rounding t
+        void evaluate_tick(long tick, double & output, int & sync) const;
         bool is_applying() const;
-        const std::vector<double> & phases() const;
-        double rest_level() const;
-        double step_delay() const;
-        double step_level() const;
-        std::string to_string() const;
-        int trace_alternance() const;
-        int trace_count() const;
-        double trace_pause() const;
+        // Lets the trace being applied finish, then stops
+        void request_stop();
+        // Ends the settling period of the trace being applied, transients
+        // being over: the multisine period starting now is the measured one
+        void settle();
+        // Samples of all traces, empty until synthesized by the builder or
+        // by the first apply()
+        const std::vector<double> & waveform() const;
 
 private:
-        explicit Stimulation(
-                const Frequencies & frequencies,
-                const std::vector<double> & amplitudes,
-                const std::vector<double> & phases,
-                double rest_level,
-                double step_level,
-                double step_delay,
-                double drop_delay,
-                int trace_count,
-                double trace_pause,
-                int trace_alternance);
-
-        void precompute();
+        struct Waveform
+        {
+                std::vector<double> output;
+                std::vector<int> sync;
+                WaveformPyramid pyramid;
+        };
 
-        Frequencies frequencies_;
-        std::vector<double> amplitudes_;
-        std::vector<double> phases_;
-        double rest_level_;
-        double step_level_;
-        double step_delay_;
-        double drop_delay_;
-        int trace_count_;
-        double trace_pause_;
-        int trace_alternance_;
+        // Moves to tick, false once the stimulation is over: otherwise index
+        // is that of the sample to apply
+        bool advance(long tick, std::size_t & index, int & sync) const;
+        // False if aborted, leaving the waveform unknown
+        bool precompute(const Progress & progress = {});
+        // Takes over from previous, being applied at tick, from the same
+        // point in time, indices being rescaled to dt
+        void resume(const Stimulation & previous, long tick);
+        std::vector<double> synthesize(
+                std::size_t size,
+                const Progress & progress) const;
 
-        mutable bool applying_;
-        mutable std::vector<double> computed_output_;
-        mutable std::vector<int> computed_sync_;
+        mutable bool applying_{};
+        mutable bool stop_requested_{};
+        mutable std::size_t stop_at_{};
+        mutable bool settle_requested_{};
+        mutable std::size_t skip_{};
+        mutable std::size_t skip_at_{};
+        mutable std::size_t skip_size_{};
+        mutable std::size_t measure_begin_{};
+        mutable std::size_t measure_end_{};
+        std::shared_ptr<const Waveform> waveform_;
 
+        friend class MultichannelStimulation;
         friend class StimulationBuilder;
-        friend class StimulationConverter;
 };
 }
 
@@ -52,11 +52,91 @@ Stimulation StimulationBuilder::build() const
                 min_frequency_ / df,
                 max_frequency_ / df,
                 seed_frequencies_);
+        auto stimulation = build_channel(intermodulation, 0);
+        stimulation.precompute();
+        return stimulation;
+}
+
+MultichannelStimulation StimulationBuilder::build_channels(
+        int count,
+        const Progress & progress) const
+{
+        auto cancelled = false;
+        auto report = [&](Stage stage, double fraction)
+        {
+                if (progress && !cancelled)
+                        cancelled = !progress(stage, fraction);
+                return !cancelled;
+        };
+        auto df = 1 / duration_;
+        auto plans = Qsa::Intermodulation::make_channels(
+                count,
+                min_frequency_ / df,
+                max_frequency_ / df,
+                seed_frequencies_,
+                [&](double fraction)
+                {
+                        return report(STAGE_INTERMODULATION, fraction);
+                });
+        if (cancelled)
+                return {};
+        std::vector<Stimulation> channels;
+        for (std::size_t k = 0; k < plans.size(); k++)
+        {
+                auto channel = build_channel(plans[k], k);
+                auto synthesized = channel.precompute([&](double fraction)
+                {
+                        auto done = (k + fraction) / plans.size();
+                        return report(STAGE_SYNTHESIS, done);
+                });
+                if (!synthesized)
+                        return {};
+                channels.push_back(channel);
+        }
+        return MultichannelStimulation(channels);
+}
+
+MultichannelStimulation StimulationBuilder::resample(
+        const MultichannelStimulation & stimulation,
+        double dt,
+        const Progress & progress)
+{
+        // Synthesis is spectral, which takes a single inverse FFT per channel
+        // as long as every generator stays below the Nyquist frequency
+        auto count = stimulation.channel_count();
+        std::vector<Stimulation> channels;
+        for (std::size_t k = 0; k < count; k++)
+        {
+                StimulationDescriptor descriptor = stimulation.channel(k);
+                const auto & frequencies = descriptor.frequencies_;
+                descriptor.frequencies_ = Frequencies{
+                        frequencies.intermodulation(),
+                        dt,
+                        frequencies.duration()};
+                Stimulation channel{descriptor};
+                auto synthesized = channel.precompute([&](double fraction)
+                {
+                        auto done = (k + fraction) / count;
+                        return !progress || progress(STAGE_SYNTHESIS, done);
+                });
+                if (!synthesized)
+                        return {};
+                channels.push_back(channel);
+        }
+        if (channels.empty())
+                return {};
+        return MultichannelStimulation(channels);
+}
+
+Stimulation StimulationBuilder::build_channel(
+        const Intermodulation & intermodulation,
+        int channel) const
+{
         auto n = intermodulation.generators().size();
         Qsa::Frequencies frequencies{intermodulation, dt_, duration_};
         std::vector<double> amplitudes(n, amplitude_);
-        auto phases = build_phases(n);
-        return Stimulation{
+        auto phases = build_phases(n, channel);
+        StimulationDescriptor descriptor{
                 frequencies,
                 amplitudes,
                 phases,
@@ -67,12 +147,16 @@ Stimulation StimulationBuilder::build() const
                 trace_count_,
                 trace_pause_,
                 trace_alternance_};
+        return Stimulation{descriptor};
 }
 
-std::vector<double> StimulationBuilder::build_phases(std::size_t n) const
+std::vector<double> StimulationBuilder::build_phases(
+        std::size_t n,
+        int channel) const
 {
+        // Channel k of a seeded stimulation draws from seed_phases_ + k
         std::random_device rd;
-        std::seed_seq seq{seed_phases_ == 0 ? rd() : seed_phases_};
+        std::seed_seq seq{seed_phases_ == 0 ? rd() : seed_phases_ + channel};
         std::mt19937 mersenne_engine{seq};
         std::uniform_real_distribution<double> distribution{0, 2 * M_PI};
         auto generate = [&distribution, &mersenne_engine]()
@@ -21,8 +21,11 @@
 #ifndef QSA_STIMULATIONBUILDER_H
 #define QSA_STIMULATIONBUILDER_H
 
+#include "intermodulation.h"
+#include "multichannelstimulation.h"
 #include "stimulation.h"
 
+#include <functional>
 #include <vector>
 
 namespace Qsa
@@ -30,9 +33,31 @@ namespace Qsa
 class StimulationBuilder
 {
 public:
+        enum Stage
+        {
+                STAGE_INTERMODULATION,
+                STAGE_SYNTHESIS
+        };
+
+        // Called with the stage reached and the fraction of it done, returns
+        // false to abort
+        using Progress = std::function<bool(Stage stage, double fraction)>;
+
         StimulationBuilder();
 
         Stimulation build() const;
+        // Channels planned jointly, see Intermodulation::make_channels(),
+        // with phases of their own. Without channel if aborted.
+        MultichannelStimulation build_channels(
+                int count,
+                const Progress & progress = {}) const;
+        // Same channels synthesized anew at another dt, e.g. once the real
+        // time period changed, their frequencies and phases being kept.
+        // Without channel if aborted.
+        static MultichannelStimulation resample(
+                const MultichannelStimulation & stimulation,
+                double dt,
+                const Progress & progress = {});
         StimulationBuilder & set_amplitude(double amplitude);
         StimulationBuilder & set_dt(double dt);
         StimulationBuilder & set_duration(double duration);
@@ -49,7 +74,11 @@ public:
         StimulationBuilder & set_trace_alternance(int trace_alternance);
 
 private:
-        std::vector<double> build_phases(std::size_t n) const;
+        // Not synthesized yet
+        Stimulation build_channel(
+                const Intermodulation & intermodulation,
+                int channel) const;
+        std::vector<double> build_phases(std::size_t n, int channel) const;
 
         double dt_;
         double duration_;
@@ -18,80 +18,180 @@
  * along with OpenQSA.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+
 #include "stimulationconverter.h"
 
-#include <iomanip>
-#include <limits>
+#include <charconv>
+#include <stdexcept>
+#include <system_error>
+#include <vector>
 
 namespace
 {
-double string_to_double(const std::string & s)
+// Reads the encoding line by line, in place
+class Parser
 {
-        std::istringstream iss(s);
-        iss.imbue(std::locale("C"));
-        double value;
-        iss >> value;
-        return value;
-}
+public:
+        explicit Parser(std::string_view text)
+        :
+                text_(text),
+                line_(0)
+        {
+        }
 
-void parse_line(
-        std::stringstream & ss,
-        const std::string & key,
-        std::string & value)
-{
-        std::string line;
-        if (!std::getline(ss, line))
-                throw std::exception();
-        auto index = line.find(":");
-        if (line.substr(0, index) != key)
-                throw std::exception();
-        value = line.substr(index + 2);
-}
+        // Value of the next line, which must hold the given key
+        Parser & line(const char * key)
+        {
+                key_ = key;
+                line_++;
+                if (text_.empty())
+                        fail("missing line");
+                auto end = text_.find('\n');
+                value_ = text_.substr(0, end);
+                text_.remove_prefix(
+                        end == std::string_view::npos ?
+                        text_.size() :
+                        end + 1);
+                if (!value_.empty() && value_.back() == '\r')
+                        value_.remove_suffix(1);
+                auto colon = value_.find(':');
+                if (colon == std::string_view::npos ||
+                        value_.substr(0, colon) != key_)
+                        fail("expected key");
+                value_.remove_prefix(colon + 1);
+                return *this;
+        }
 
-void parse_double(const std::string & value, double & result)
-{
-        result = string_to_double(value);
-}
+        template <typename T>
+        void read(T & result)
+        {
+                auto token = next_token();
+                if (token.empty())
+                        fail("missing value");
+                result = convert<T>(token);
+                token = next_token();
+                if (!token.empty())
+                        fail("unexpected value", token);
+        }
 
-void parse_int(const std::string & value, int & result)
-{
-        result = std::stoi(value);
-}
+        template <typename T>
+        void read(std::vector<T> & result)
+        {
+                result.clear();
+                for (auto token = next_token(); !token.empty();
+                        token = next_token())
+                        result.push_back(convert<T>(token));
+        }
 
-void parse_double_vector(
-        const std::string & value,
-        std::vector<double> & result)
-{
-        std::stringstream ss(value);
-        std::string token;
-        result.clear();
-        while (std::getline(ss, token, ' '))
+        // Same, one value per generator
+        template <typename T>
+        void read(std::vector<T> & result, std::size_t count)
+        {
+                read(result);
+                if (result.size() != count)
+                        fail("one value per generator expected");
+        }
+
+private:
+        template <typename T>
+        T convert(std::string_view token) const
+        {
+                T result{};
+                auto end = token.data() + token.size();
+                auto [ptr, error] = std::from_chars(token.data(), end, result);
+                if (error == std::errc::result_out_of_range)
+                        fail("out of range number", token);
+                if (error != std::errc() || ptr != end)
+                        fail("invalid number", token);
+                return result;
+        }
+
+        [[noreturn]] void fail(
+                const char * what,
+                std::string_view token = {}) const
         {
-                
+                auto message = "stimulation line " + std::to_string(line_) +
+                        " (" + key_ + "): " + what;
                 if (!token.empty())
-                        result.push_back(string_to_double(token));
+                        message += " \"" + std::string(token) + "\"";
+                throw std::runtime_error(message);
         }
-}
 
-void parse_int_vector(const std::string & value, std::vector<int> & result)
+        std::string_view next_token()
+        {
+                auto first = value_.find_first_not_of(" \t");
+                if (first == std::string_view::npos)
+                {
+                        value_ = {};
+                        return {};
+                }
+                value_.remove_prefix(first);
+                auto last = value_.find_first_of(" \t");
+                auto token = value_.substr(0, last);
+                value_.remove_prefix(token.size());
+                return token;
+        }
+
+        std::string_view text_;
+        std::string_view value_;
+        const char * key_ = "";
+        std::size_t line_;
+};
+
+// Appends values in their shortest round-trip form
+class Printer
 {
-        std::stringstream ss(value);
-        std::string token;
-        result.clear();
-        while (std::getline(ss, token, ' '))
+public:
+        explicit Printer(std::string & text)
+        :
+                text_(text)
         {
-                if (!token.empty())
-                        result.push_back(std::stoi(token));
         }
-}
+
+        Printer & key(const char * name)
+        {
+                text_ += name;
+                text_ += ':';
+                return *this;
+        }
+
+        template <typename T>
+        Printer & value(T number)
+        {
+                char buffer[32];
+                auto result = std::to_chars(
+                        buffer,
+                        buffer + sizeof(buffer),
+                        number);
+                text_ += ' ';
+                text_.append(buffer, result.ptr);
+                return *this;
+        }
+
+        template <typename Range>
+        Printer & values(const Range & numbers)
+        {
+                for (auto number : numbers)
+                        value(number);
+                return *this;
+        }
+
+        void end_line()
+        {
+                text_ += '\n';
+        }
+
+private:
+        std::string & text_;
+};
 }
 
 namespace Qsa
 {
-Stimulation StimulationConverter::parse(const std::string & stimulation_string)
+StimulationDescriptor StimulationConverter::parse(
+        std::string_view stimulation_string)
 {
-        std::stringstream ss(stimulation_string);
-        std::string value;
+        Parser parser(stimulation_string);
         double dt;
         double duration;
         std::vector<int> generators;
@@ -104,40 +204,22 @@ Stimulation StimulationConverter::parse(const std::string & stimulation_string)
         int trace_count;
         double trace_pause;
         int trace_alternance;
-        try
-        {
-                parse_line(ss, "dt", value);
-                parse_double(value, dt);
-                parse_line(ss, "duration", value);
-                parse_double(value, duration);
-                parse_line(ss, "generators", value);
-                parse_int_vector(value, generators);
-                parse_line(ss, "amplitudes", value);
-                parse_double_vector(value, amplitudes);
-                parse_line(ss, "phases", value);
-                parse_double_vector(value, phases);
-                parse_line(ss, "rest_level", value);
-                parse_double(value, rest_level);
-                parse_line(ss, "step_level", value);
-                parse_double(value, step_level);
-                parse_line(ss, "step_delay", value);
-                parse_double(value, step_delay);
-                parse_line(ss, "drop_delay", value);
-                parse_double(value, drop_delay);
-                parse_line(ss, "trace_count", value);
-                parse_int(value, trace_count);
-                parse_line(ss, "trace_pause", value);
-                parse_double(value, trace_pause);
-                parse_line(ss, "trace_alternance", value);
-                parse_int(value, trace_alternance);
-        }
-        catch (...)
-        {
-                return {};
-        }
-        auto intermodulation = Intermodulation::make(generators);
+        parser.line("dt").read(dt);
+        parser.line("duration").read(duration);
+        parser.line("generators").read(generators);
+        parser.line("amplitudes").read(amplitudes, generators.size());
+        parser.line("phases").read(phases, generators.size());
+        parser.line("rest_level").read(rest_level);
+        parser.line("step_level").read(step_level);
+        parser.line("step_delay").read(step_delay);
+        parser.line("drop_delay").read(drop_delay);
+        parser.line("trace_count").read(trace_count);
+        parser.line("trace_pause").read(trace_pause);
+        parser.line("trace_alternance").read(trace_alternance);
+
+        auto intermodulation = Intermodulation::from_generators(generators);
         Frequencies frequencies{intermodulation, dt, duration};
-        return Stimulation{
+        return StimulationDescriptor{
                 frequencies,
                 amplitudes,
                 phases,
@@ -150,32 +232,31 @@ Stimulation StimulationConverter::parse(const std::string & stimulation_string)
                 trace_alternance};
 }
 
-std::string StimulationConverter::print(const Stimulation & stimulation)
+std::string StimulationConverter::print(
+        const StimulationDescriptor & stimulation)
 {
-        std::stringstream ss;
-        ss << std::setprecision(std::numeric_limits<double>::digits10 + 1);
-        ss << "dt: " << stimulation.frequencies().dt() << std::endl;
-        ss << "duration: " << stimulation.frequencies().duration() << std::endl;
-        ss << "generators:";
-        for (auto g : stimulation.frequencies().intermodulation().generators())
-                ss << " " << g;
-        ss << std::endl;
-        ss << "amplitudes:";
-        for (auto amplitude : stimulation.amplitudes())
-                ss << " " << amplitude;
-        ss << std::endl;
-        ss << "phases:";
-        for (auto phase : stimulation.phases())
-                ss << " " << phase;
-        ss << std::endl;
-        ss << "rest_level: " << stimulation.rest_level() << std::endl;
-        ss << "step_level: " << stimulation.step_level() << std::endl;
-        ss << "step_delay: " << stimulation.step_delay() << std::endl;
-        ss << "drop_delay: " << stimulation.drop_delay() << std::endl;
-        ss << "trace_count: " << stimulation.trace_count() << std::endl;
-        ss << "trace_pause: " << stimulation.trace_pause() << std::endl;
-        ss << "trace_alternance: " << stimulation.trace_alternance()
-                << std::endl;
-        return ss.str();
+        const auto & frequencies = stimulation.frequencies();
+        std::string result;
+        result.reserve(
+                256 + 25 * (stimulation.amplitudes().size() +
+                stimulation.phases().size()));
+        Printer printer(result);
+        printer.key("dt").value(frequencies.dt()).end_line();
+        printer.key("duration").value(frequencies.duration()).end_line();
+        printer.key("generators")
+                .values(frequencies.intermodulation().generators())
+                .end_line();
+        printer.key("amplitudes").values(stimulation.amplitudes()).end_line();
+        printer.key("phases").values(stimulation.phases()).end_line();
+        printer.key("rest_level").value(stimulation.rest_level()).end_line();
+        printer.key("step_level").value(stimulation.step_level()).end_line();
+        printer.key("step_delay").value(stimulation.step_delay()).end_line();
+        printer.key("drop_delay").value(stimulation.drop_delay()).end_line();
+        printer.key("trace_count").value(stimulation.trace_count()).end_line();
+        printer.key("trace_pause").value(stimulation.trace_pause()).end_line();
+        printer.key("trace_alternance")
+                .value(stimulation.trace_alternance())
+                .end_line();
+        return result;
 }
 }
@@ -18,21 +18,27 @@
  * along with OpenQSA.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+
 #ifndef QSA_STIMULATIONCONVERTER_H
 #define QSA_STIMULATIONCONVERTER_H
 
-#include "stimulation.h"
+#include "stimulationdescriptor.h"
 
-#include <sstream>
 #include <string>
+#include <string_view>
 
 namespace Qsa
 {
+// Text encoding of stimulations, one "key: value" line per parameter, as
+// copied from QsaStimulation and pasted into QsaResponse. Doubles are printed
+// with the fewest digits that read back to the same value. Parsing throws
+// std::runtime_error naming the line and key at fault.
 class StimulationConverter
 {
 public:
-        static Stimulation parse(const std::string & stimulation_string);
-        static std::string print(const Stimulation & stimulation);
+        static StimulationDescriptor parse(
+                std::string_view stimulation_string);
+        static std::string print(const StimulationDescriptor & stimulation);
 };
 }
 
@@ -0,0 +1,130 @@
+/*
+ * Quadratic Sinusoidal Analysis.
+ * Copyright (C) 2018 OpenQSA.
+ * 
+ * This file is part of OpenQSA.
+ * 
+ * OpenQSA is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ * 
+ * OpenQSA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with OpenQSA.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "stimulationdescriptor.h"
+
+#include <iomanip>
+#include <limits>
+#include <sstream>
+
+namespace Qsa
+{
+const std::vector<double> & StimulationDescriptor::amplitudes() const
+{
+        return amplitudes_;
+}
+
+double StimulationDescriptor::drop_delay() const
+{
+        return drop_delay_;
+}
+
+const Frequencies & StimulationDescriptor::frequencies() const
+{
+        return frequencies_;
+}
+
+const std::vector<double> & StimulationDescriptor::phases() const
+{
+        return phases_;
+}
+
+double StimulationDescriptor::rest_level() const
+{
+        return rest_level_;
+}
+
+double StimulationDescriptor::step_delay() const
+{
+        return step_delay_;
+}
+
+double StimulationDescriptor::step_level() const
+{
+        return step_level_;
+}
+
+std::string StimulationDescriptor::to_string() const
+{
+        std::stringstream ss;
+        ss << std::setprecision(std::numeric_limits<double>::digits10 + 1);
+        ss << "Dt (s): " << frequencies_.dt() << std::endl;
+        ss << "Duration (s): " << frequencies_.duration() << std::endl;
+        ss << "Frequencies (Hz):";
+        for (auto fundamental : frequencies_.fundamentals())
+                ss << " " << fundamental;
+        ss << std::endl;
+        ss << "Amplitudes:";
+        for (auto amplitude : amplitudes_)
+                ss << " " << amplitude;
+        ss << std::endl;
+        ss << "Phases:";
+        for (auto phase : phases_)
+                ss << " " << phase;
+        ss << std::endl;
+        ss << "Rest level: " << rest_level_ << std::endl;
+        ss << "Step level: " << step_level_ << std::endl;
+        ss << "Step delay (s): " << step_delay_ << std::endl;
+        ss << "Trace count: " << trace_count_ << std::endl;
+        ss << "Trace pause: " << trace_pause_ << std::endl;
+        ss << "Trace alternance: " << trace_alternance_ << std::endl;
+        return ss.str();
+}
+
+int StimulationDescriptor::trace_alternance() const
+{
+        return trace_alternance_;
+}
+
+int StimulationDescriptor::trace_count() const
+{
+        return trace_count_;
+}
+
+double StimulationDescriptor::trace_pause() const
+{
+        return trace_pause_;
+}
+
+StimulationDescriptor::StimulationDescriptor(
+        const Frequencies & frequencies,
+        const std::vector<double> & amplitudes,
+        const std::vector<double> & phases,
+        double rest_level,
+        double step_level,
+        double step_delay,
+        double drop_delay,
+        int trace_count,
+        double trace_pause,
+        int trace_alternance)
+:
+        frequencies_(frequencies),
+        amplitudes_(amplitudes),
+        phases_(phases),
+        rest_level_(rest_level),
+        step_level_(step_level),
+        step_delay_(step_delay),
+        drop_delay_(drop_delay),
+        trace_count_(trace_count),
+        trace_pause_(trace_pause),
+        trace_alternance_(trace_alternance)
+{
+}
+}
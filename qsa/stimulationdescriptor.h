@@ -0,0 +1,86 @@
+/*
+ * Quadratic Sinusoidal Analysis.
+ * Copyright (C) 2018 OpenQSA.
+ * 
+ * This file is part of OpenQSA.
+ * 
+ * OpenQSA is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ * 
+ * OpenQSA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with OpenQSA.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef QSA_STIMULATIONDESCRIPTOR_H
+#define QSA_STIMULATIONDESCRIPTOR_H
+
+#include "frequencies.h"
+
+#include <string>
+#include <vector>
+
+namespace Qsa
+{
+// Parameters of a stimulation, without its waveform: all the recording side
+// needs to segment and analyse responses. A Stimulation is sliced into one
+// by copy, and built from one when it is to be applied.
+class StimulationDescriptor
+{
+public:
+        StimulationDescriptor() = default;
+        StimulationDescriptor(const StimulationDescriptor &) = default;
+        StimulationDescriptor & operator=(const StimulationDescriptor &) =
+                default;
+        ~StimulationDescriptor() = default;
+
+        const std::vector<double> & amplitudes() const;
+        double drop_delay() const;
+        const Frequencies & frequencies() const;
+        const std::vector<double> & phases() const;
+        double rest_level() const;
+        double step_delay() const;
+        double step_level() const;
+        std::string to_string() const;
+        int trace_alternance() const;
+        int trace_count() const;
+        double trace_pause() const;
+
+protected:
+        Frequencies frequencies_;
+        std::vector<double> amplitudes_;
+        std::vector<double> phases_;
+        double rest_level_{};
+        double step_level_{};
+        double step_delay_{};
+        double drop_delay_{};
+        int trace_count_{};
+        double trace_pause_{};
+        int trace_alternance_{};
+
+private:
+        explicit StimulationDescriptor(
+                const Frequencies & frequencies,
+                const std::vector<double> & amplitudes,
+                const std::vector<double> & phases,
+                double rest_level,
+                double step_level,
+                double step_delay,
+                double drop_delay,
+                int trace_count,
+                double trace_pause,
+                int trace_alternance);
+
+        friend class RecordingReader;
+        friend class StimulationBuilder;
+        friend class StimulationConverter;
+};
+}
+
+#endif /* QSA_STIMULATIONDESCRIPTOR_H */
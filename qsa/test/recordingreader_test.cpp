@@ -0,0 +1,129 @@
+/*
+ * Quadratic Sinusoidal Analysis.
+ * Copyright (C) 2018 OpenQSA.
+ * 
+ * This file is part of OpenQSA.
+ * 
+ * OpenQSA is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ * 
+ * OpenQSA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with OpenQSA.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Reading of recordings whose keys are escaped or out of order, and rejection
+// of malformed escapes
+
+#include "recording.h"
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace
+{
+const char * FILENAME = "recordingreader_test.json";
+
+// Traces before the header, some keys written with escapes
+std::string document(const std::string & note)
+{
+        return std::string(
+                "{\"traces\": [{"
+                "\"st\\u0065p\": {\"time\": [0, 0.001, 0.002], "
+                "\"stimulation\": [1, 2, 3], \"response\": [4, 5, 6]}, "
+                "\"multisine\": {\"response\": [], \"stimulation\": [], "
+                "\"time\": []}, "
+                "\"drop\": {\"response\": [], \"stimulation\": [], "
+                "\"time\": []}}], "
+                "\"note\": \"") + note + "\", "
+                "\"\\u0064t\": 0.001, \"duration\": 1.0, "
+                "\"frequencies\": [3.0, 5.0], \"amplitudes\": [1, 1], "
+                "\"phases\": [0, 0], \"rest_level\": -1, "
+                "\"step_level\": -0.5, \"step_delay\": 0.002, "
+                "\"drop_delay\": 0, \"trace\\u005fcount\": 1, "
+                "\"trace_pause\": 0, \"trace_alternance\": 0}";
+}
+
+Qsa::Recording load(const std::string & text)
+{
+        {
+                std::ofstream file(FILENAME);
+                file << text;
+        }
+        try
+        {
+                auto recording = Qsa::Recording::load(FILENAME);
+                std::remove(FILENAME);
+                return recording;
+        }
+        catch (...)
+        {
+                std::remove(FILENAME);
+                throw;
+        }
+}
+
+bool rejected(const std::string & note)
+{
+        try
+        {
+                load(document(note));
+                return false;
+        }
+        catch (const std::runtime_error &)
+        {
+                return true;
+        }
+}
+}
+
+int main()
+{
+        auto failures = 0;
+        auto check = [&](bool condition, const char * what)
+        {
+                if (!condition)
+                {
+                        std::cerr << what << "\n";
+                        failures++;
+                }
+        };
+
+        // One, two, three and four byte code points, the last as a pair
+        auto recording = load(document("\\u0041\\u00e9\\u20ac\\ud83d\\ude00"));
+        const auto & stimulation = recording.stimulation();
+        check(stimulation.frequencies().dt() == 0.001, "escaped key dt");
+        check(stimulation.trace_count() == 1, "escaped key trace_count");
+        check(stimulation.step_level() == -0.5, "header after traces");
+        check(recording.traces().size() == 1, "trace count");
+        if (recording.traces().size() == 1)
+        {
+                const auto & step = recording.traces()[0].step_;
+                check(step.start_tick_ == 2, "start tick");
+                check(step.stimulation_ == std::vector<double>({1, 2, 3}),
+                        "step stimulation");
+                check(step.response_ == std::vector<double>({4, 5, 6}),
+                        "step response");
+        }
+
+        // Surrogates come in pairs, high then low
+        check(rejected("\\ud83d"), "lone high surrogate accepted");
+        check(rejected("\\ude00"), "lone low surrogate accepted");
+        check(rejected("\\ud83d\\u0041"), "high surrogate alone accepted");
+        check(rejected("\\ud83d\\ud83d"), "two high surrogates accepted");
+        check(rejected("\\u00g0"), "invalid hexadecimal digit accepted");
+        check(rejected("\\x"), "invalid escape accepted");
+
+        std::cout << "recording reader, " << failures << " failures\n";
+        return failures == 0 ? 0 : 1;
+}
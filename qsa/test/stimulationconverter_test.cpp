@@ -0,0 +1,308 @@
+/*
+ * Quadratic Sinusoidal Analysis.
+ * Copyright (C) 2018 OpenQSA.
+ * 
+ * This file is part of OpenQSA.
+ * 
+ * OpenQSA is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ * 
+ * OpenQSA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with OpenQSA.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Round trip of random descriptors through StimulationConverter, every
+// double having to come back with the same bits
+
+#include "stimulationconverter.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace
+{
+const int ROUND_TRIPS = 10000;
+
+using limits = std::numeric_limits<double>;
+
+// Edge cases of the shortest representation, as well as random values
+const double SPECIAL[] = {
+        0.0,
+        -0.0,
+        limits::denorm_min(),
+        -limits::denorm_min(),
+        2.2250738585072009e-308, // largest subnormal
+        limits::min(),
+        limits::max(),
+        limits::lowest(),
+        limits::infinity(),
+        -limits::infinity(),
+        limits::epsilon(),
+        0.1,
+        1.0 / 3,
+        0.30000000000000004,
+        1.7976931348623155e308,
+        4.9406564584124654e-324,
+        9007199254740991.0,
+        123456789012345680.0,
+        1e23,
+        5e-324 * 3};
+
+std::uint64_t bits(double value)
+{
+        std::uint64_t result;
+        std::memcpy(&result, &value, sizeof(result));
+        return result;
+}
+
+class Generator
+{
+public:
+        explicit Generator(unsigned seed)
+        :
+                engine_(seed)
+        {
+        }
+
+        double number()
+        {
+                switch (engine_() % 4)
+                {
+                case 0:
+                {
+                        // Any bit pattern but NaN, whose payload is not kept
+                        double value;
+                        do
+                        {
+                                auto pattern = engine_();
+                                std::memcpy(&value, &pattern, sizeof(value));
+                        }
+                        while (value != value);
+                        return value;
+                }
+                case 1:
+                        return SPECIAL[engine_() % std::size(SPECIAL)];
+                case 2:
+                        return std::uniform_real_distribution<>(-1, 1)(
+                                engine_);
+                default:
+                        return std::uniform_real_distribution<>(0, 1)(
+                                engine_) * 1e-3;
+                }
+        }
+
+        int integer()
+        {
+                const int special[] = {
+                        0,
+                        -1,
+                        1,
+                        std::numeric_limits<int>::min(),
+                        std::numeric_limits<int>::max()};
+                return engine_() % 2 == 0 ?
+                        special[engine_() % std::size(special)] :
+                        static_cast<int>(engine_());
+        }
+
+        std::vector<int> generators()
+        {
+                std::set<int> result;
+                auto count = 1 + engine_() % 12;
+                while (result.size() < count)
+                        result.insert(1 + engine_() % 500);
+                // As the parser turns them into a valid set
+                auto valid = Qsa::Intermodulation::from_generators(
+                        {result.begin(), result.end()}).generators();
+                return {valid.begin(), valid.end()};
+        }
+
+        std::vector<double> numbers(std::size_t count)
+        {
+                std::vector<double> result;
+                for (std::size_t i = 0; i < count; i++)
+                        result.push_back(number());
+                return result;
+        }
+
+private:
+        std::mt19937_64 engine_;
+};
+
+bool same(double a, double b)
+{
+        return bits(a) == bits(b);
+}
+
+bool same(const std::vector<double> & a, const std::vector<double> & b)
+{
+        if (a.size() != b.size())
+                return false;
+        for (std::size_t i = 0; i < a.size(); i++)
+        {
+                if (!same(a[i], b[i]))
+                        return false;
+        }
+        return true;
+}
+
+// Values of a descriptor, in the order of the encoding
+struct Values
+{
+        double dt_;
+        double duration_;
+        std::vector<int> generators_;
+        std::vector<double> amplitudes_;
+        std::vector<double> phases_;
+        double rest_level_;
+        double step_level_;
+        double step_delay_;
+        double drop_delay_;
+        int trace_count_;
+        double trace_pause_;
+        int trace_alternance_;
+};
+
+// Independently of StimulationConverter::print, 17 significant digits
+// being enough for any double
+std::string encode(const Values & values)
+{
+        auto number = [](double value)
+        {
+                char text[32];
+                std::snprintf(text, sizeof(text), " %.17g", value);
+                return std::string(text);
+        };
+        std::string result;
+        result += "dt:" + number(values.dt_) + "\n";
+        result += "duration:" + number(values.duration_) + "\n";
+        result += "generators:";
+        for (auto generator : values.generators_)
+                result += " " + std::to_string(generator);
+        result += "\namplitudes:";
+        for (auto amplitude : values.amplitudes_)
+                result += number(amplitude);
+        result += "\nphases:";
+        for (auto phase : values.phases_)
+                result += number(phase);
+        result += "\nrest_level:" + number(values.rest_level_) + "\n";
+        result += "step_level:" + number(values.step_level_) + "\n";
+        result += "step_delay:" + number(values.step_delay_) + "\n";
+        result += "drop_delay:" + number(values.drop_delay_) + "\n";
+        result += "trace_count: " + std::to_string(values.trace_count_) +
+                "\n";
+        result += "trace_pause:" + number(values.trace_pause_) + "\n";
+        result += "trace_alternance: " +
+                std::to_string(values.trace_alternance_) + "\n";
+        return result;
+}
+
+bool same(const Values & a, const Qsa::StimulationDescriptor & b)
+{
+        const auto & frequencies = b.frequencies();
+        const auto & generators = frequencies.intermodulation().generators();
+        return same(a.dt_, frequencies.dt()) &&
+                same(a.duration_, frequencies.duration()) &&
+                std::vector<int>(generators.begin(), generators.end()) ==
+                        a.generators_ &&
+                same(a.amplitudes_, b.amplitudes()) &&
+                same(a.phases_, b.phases()) &&
+                same(a.rest_level_, b.rest_level()) &&
+                same(a.step_level_, b.step_level()) &&
+                same(a.step_delay_, b.step_delay()) &&
+                same(a.drop_delay_, b.drop_delay()) &&
+                a.trace_count_ == b.trace_count() &&
+                same(a.trace_pause_, b.trace_pause()) &&
+                a.trace_alternance_ == b.trace_alternance();
+}
+
+// Encodings that must be rejected
+bool rejected(const std::string & text)
+{
+        try
+        {
+                Qsa::StimulationConverter::parse(text);
+                return false;
+        }
+        catch (const std::runtime_error &)
+        {
+                return true;
+        }
+}
+}
+
+int main()
+{
+        Generator generator(20181023);
+        auto failures = 0;
+        for (auto i = 0; i < ROUND_TRIPS; i++)
+        {
+                Values values;
+                values.dt_ = generator.number();
+                values.duration_ = generator.number();
+                values.generators_ = generator.generators();
+                auto count = values.generators_.size();
+                values.amplitudes_ = generator.numbers(count);
+                values.phases_ = generator.numbers(count);
+                values.rest_level_ = generator.number();
+                values.step_level_ = generator.number();
+                values.step_delay_ = generator.number();
+                values.drop_delay_ = generator.number();
+                values.trace_count_ = generator.integer();
+                values.trace_pause_ = generator.number();
+                values.trace_alternance_ = generator.integer();
+
+                // Parsed, then printed and parsed again, as the clipboard
+                // and shared memory do
+                auto text = encode(values);
+                auto parsed = Qsa::StimulationConverter::parse(text);
+                auto printed = Qsa::StimulationConverter::print(parsed);
+                auto reparsed = Qsa::StimulationConverter::parse(printed);
+                if (!same(values, parsed) ||
+                        !same(values, reparsed) ||
+                        Qsa::StimulationConverter::print(reparsed) != printed)
+                {
+                        if (failures++ == 0)
+                                std::cerr << "mismatch:\n" << text
+                                        << "printed as:\n" << printed;
+                }
+        }
+
+        // Amplitudes and phases must match generators
+        const char * header = "dt: 0.001\nduration: 1\ngenerators: 3 5\n";
+        const char * tail =
+                "rest_level: 0\nstep_level: 0\nstep_delay: 0\n"
+                "drop_delay: 0\ntrace_count: 1\ntrace_pause: 0\n"
+                "trace_alternance: 0\n";
+        auto encode = [&](const char * amplitudes, const char * phases)
+        {
+                return std::string(header) + "amplitudes:" + amplitudes +
+                        "\nphases:" + phases + "\n" + tail;
+        };
+        if (rejected(encode(" 1 1", " 0 0")) ||
+                !rejected(encode(" 1", " 0 0")) ||
+                !rejected(encode(" 1 1", " 0 0 0")))
+        {
+                std::cerr << "value counts not checked\n";
+                failures++;
+        }
+
+        std::cout << ROUND_TRIPS << " round trips, " << failures
+                << " failures\n";
+        return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,224 @@
+/*
+ * Quadratic Sinusoidal Analysis.
+ * Copyright (C) 2018 OpenQSA.
+ * 
+ * This file is part of OpenQSA.
+ * 
+ * OpenQSA is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ * 
+ * OpenQSA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with OpenQSA.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "threadpool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <exception>
+
+namespace
+{
+// Pool and queue of the worker running on the current thread, if any
+thread_local const Qsa::ThreadPool * current_pool = nullptr;
+thread_local std::size_t current_queue = 0;
+
+// Waiting threads look for new tasks to run at this interval
+const std::chrono::milliseconds POLL_INTERVAL(1);
+}
+
+namespace Qsa
+{
+ThreadPool::ThreadPool()
+:
+        ThreadPool(std::max(1U, std::thread::hardware_concurrency()))
+{
+}
+
+ThreadPool::~ThreadPool()
+{
+        wait();
+        {
+                std::lock_guard<std::mutex> lock(mutex_);
+                stopping_ = true;
+        }
+        wake_.notify_all();
+        for (auto & thread : threads_)
+                thread.join();
+}
+
+ThreadPool::ThreadPool(std::size_t size)
+:
+        queued_(0),
+        unfinished_(0),
+        next_queue_(0),
+        stopping_(false)
+{
+        // Without workers, tasks are run by threads waiting for them
+        for (std::size_t i = 0; i < std::max<std::size_t>(size, 1); i++)
+                queues_.push_back(std::make_unique<Queue>());
+        for (std::size_t i = 0; i < size; i++)
+                threads_.emplace_back(&ThreadPool::work, this, i);
+}
+
+void ThreadPool::parallel_for(
+        std::size_t count,
+        const std::function<void(std::size_t)> & job)
+{
+        // Shared with helper tasks, which may start after this call returns
+        struct State
+        {
+                std::atomic<std::size_t> next_{0};
+                std::atomic<std::size_t> done_{0};
+                const std::function<void(std::size_t)> * job_;
+                std::exception_ptr error_;
+                std::mutex mutex_;
+                std::condition_variable finished_;
+        };
+        if (count == 0)
+                return;
+        auto state = std::make_shared<State>();
+        state->job_ = &job;
+        auto run = [state, count]
+        {
+                for (std::size_t i; (i = state->next_++) < count;)
+                {
+                        try
+                        {
+                                (*state->job_)(i);
+                        }
+                        catch (...)
+                        {
+                                std::lock_guard<std::mutex> lock(
+                                        state->mutex_);
+                                if (!state->error_)
+                                        state->error_ =
+                                                std::current_exception();
+                        }
+                        if (++state->done_ == count)
+                        {
+                                std::lock_guard<std::mutex> lock(
+                                        state->mutex_);
+                                state->finished_.notify_all();
+                        }
+                }
+        };
+        for (std::size_t i = 1; i < std::min(count, size() + 1); i++)
+                submit(run);
+        run();
+
+        while (state->done_ < count)
+        {
+                if (run_pending(home()))
+                        continue;
+                std::unique_lock<std::mutex> lock(state->mutex_);
+                state->finished_.wait_for(lock, POLL_INTERVAL, [&]
+                {
+                        return state->done_ == count;
+                });
+        }
+        if (state->error_)
+                std::rethrow_exception(state->error_);
+}
+
+std::size_t ThreadPool::size() const
+{
+        return threads_.size();
+}
+
+void ThreadPool::submit(Task task)
+{
+        unfinished_++;
+        {
+                auto & queue = *queues_[home()];
+                std::lock_guard<std::mutex> lock(queue.mutex_);
+                queue.tasks_.push_back(std::move(task));
+        }
+        {
+                std::lock_guard<std::mutex> lock(mutex_);
+                queued_++;
+        }
+        wake_.notify_one();
+}
+
+void ThreadPool::wait()
+{
+        // Not to be called from a task, which is itself unfinished
+        while (unfinished_ > 0)
+        {
+                if (run_pending(home()))
+                        continue;
+                std::unique_lock<std::mutex> lock(mutex_);
+                idle_.wait_for(lock, POLL_INTERVAL, [this]
+                {
+                        return unfinished_ == 0;
+                });
+        }
+}
+
+std::size_t ThreadPool::home() const
+{
+        // Other threads spread their tasks over the queues
+        if (current_pool == this)
+                return current_queue;
+        return next_queue_++ % queues_.size();
+}
+
+bool ThreadPool::run_pending(std::size_t home)
+{
+        // Newest task of the home queue, else oldest task of another queue
+        Task task;
+        for (std::size_t i = 0; i < queues_.size() && !task; i++)
+        {
+                auto & queue = *queues_[(home + i) % queues_.size()];
+                std::lock_guard<std::mutex> lock(queue.mutex_);
+                if (queue.tasks_.empty())
+                        continue;
+                if (i == 0)
+                {
+                        task = std::move(queue.tasks_.back());
+                        queue.tasks_.pop_back();
+                }
+                else
+                {
+                        task = std::move(queue.tasks_.front());
+                        queue.tasks_.pop_front();
+                }
+        }
+        if (!task)
+                return false;
+        queued_--;
+        task();
+        if (--unfinished_ == 0)
+        {
+                std::lock_guard<std::mutex> lock(mutex_);
+                idle_.notify_all();
+        }
+        return true;
+}
+
+void ThreadPool::work(std::size_t index)
+{
+        current_pool = this;
+        current_queue = index;
+        while (true)
+        {
+                if (run_pending(index))
+                        continue;
+                std::unique_lock<std::mutex> lock(mutex_);
+                wake_.wait(lock, [this]
+                {
+                        return stopping_ || queued_ > 0;
+                });
+                if (stopping_ && queued_ == 0)
+                        return;
+        }
+}
+}
@@ -0,0 +1,85 @@
+/*
+ * Quadratic Sinusoidal Analysis.
+ * Copyright (C) 2018 OpenQSA.
+ * 
+ * This file is part of OpenQSA.
+ * 
+ * OpenQSA is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ * 
+ * OpenQSA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with OpenQSA.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef QSA_THREADPOOL_H
+#define QSA_THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Qsa
+{
+// Work-stealing thread pool. Each worker runs the tasks it submitted itself
+// last in first out, and steals the oldest tasks of other workers once its
+// own queue is empty. Threads waiting for tasks, including the caller of
+// parallel_for() or wait(), run pending tasks meanwhile, so tasks may submit
+// and wait for nested tasks without deadlocking the pool.
+class ThreadPool
+{
+public:
+        using Task = std::function<void()>;
+
+        ThreadPool();
+        ThreadPool(const ThreadPool &) = delete;
+        ThreadPool & operator=(const ThreadPool &) = delete;
+        ~ThreadPool();
+
+        explicit ThreadPool(std::size_t size);
+
+        // Runs job(0) .. job(count - 1) and returns once all are done,
+        // rethrowing the first exception thrown by a job
+        void parallel_for(
+                std::size_t count,
+                const std::function<void(std::size_t)> & job);
+        std::size_t size() const;
+        void submit(Task task); // task must not throw
+        void wait();
+
+private:
+        struct Queue
+        {
+                std::mutex mutex_;
+                std::deque<Task> tasks_;
+        };
+
+        std::size_t home() const;
+        bool run_pending(std::size_t home);
+        void work(std::size_t index);
+
+        std::vector<std::unique_ptr<Queue>> queues_;
+        std::vector<std::thread> threads_;
+        std::atomic<std::size_t> queued_;
+        std::atomic<std::size_t> unfinished_;
+        mutable std::atomic<std::size_t> next_queue_;
+        std::mutex mutex_;
+        std::condition_variable wake_;
+        std::condition_variable idle_;
+        bool stopping_;
+};
+}
+
+#endif /* QSA_THREADPOOL_H */
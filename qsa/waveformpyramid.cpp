@@ -0,0 +1,123 @@
+/*
+ * Quadratic Sinusoidal Analysis.
+ * Copyright (C) 2018 OpenQSA.
+ * 
+ * This file is part of OpenQSA.
+ * 
+ * OpenQSA is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ * 
+ * OpenQSA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with OpenQSA.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "waveformpyramid.h"
+
+#include <algorithm>
+
+namespace
+{
+// Samples per bucket of the first level, smaller ones being read directly
+const std::size_t FIRST_LEVEL = 4;
+const std::size_t FIRST_SIZE = std::size_t(1) << FIRST_LEVEL;
+
+Qsa::WaveformPyramid::Bucket merge(
+        Qsa::WaveformPyramid::Bucket a,
+        Qsa::WaveformPyramid::Bucket b)
+{
+        return {std::min(a.min_, b.min_), std::max(a.max_, b.max_)};
+}
+}
+
+namespace Qsa
+{
+WaveformPyramid::WaveformPyramid(const std::vector<double> & samples)
+{
+        if (samples.empty())
+                return;
+
+        // First level from samples, the last bucket being partial
+        std::vector<Bucket> level;
+        level.reserve((samples.size() + FIRST_SIZE - 1) / FIRST_SIZE);
+        for (std::size_t i = 0; i < samples.size(); i += FIRST_SIZE)
+        {
+                auto last = std::min(i + FIRST_SIZE, samples.size());
+                auto range = std::minmax_element(
+                        samples.begin() + i,
+                        samples.begin() + last);
+                level.push_back({*range.first, *range.second});
+        }
+        levels_.push_back(std::move(level));
+
+        // Then pairs of buckets, up to a single one
+        while (levels_.back().size() > 1)
+        {
+                const auto & below = levels_.back();
+                std::vector<Bucket> above((below.size() + 1) / 2);
+                for (std::size_t i = 0; i < above.size(); i++)
+                {
+                        above[i] = 2 * i + 1 < below.size() ?
+                                merge(below[2 * i], below[2 * i + 1]) :
+                                below[2 * i];
+                }
+                levels_.push_back(std::move(above));
+        }
+}
+
+WaveformPyramid::Bucket WaveformPyramid::bounds() const
+{
+        return levels_.empty() ? Bucket{} : levels_.back().front();
+}
+
+std::vector<WaveformPyramid::Bucket> WaveformPyramid::envelope(
+        const std::vector<double> & samples,
+        std::size_t begin,
+        std::size_t end,
+        std::size_t count) const
+{
+        end = std::min(end, samples.size());
+        if (begin >= end || count == 0)
+                return {};
+        std::vector<Bucket> result(count);
+        auto span = double(end - begin) / count;
+
+        // Finest level whose buckets are no wider than a share of the range
+        std::size_t level = 0;
+        while (level + 1 < levels_.size() &&
+                double(FIRST_SIZE << (level + 1)) <= span)
+                level++;
+        auto size = FIRST_SIZE << level;
+        auto direct = levels_.empty() || span < FIRST_SIZE;
+
+        for (std::size_t i = 0; i < count; i++)
+        {
+                auto first = begin + static_cast<std::size_t>(i * span);
+                auto last = begin + static_cast<std::size_t>((i + 1) * span);
+                last = std::min(std::max(last, first + 1), end);
+                if (direct)
+                {
+                        // Fewer samples than in the first level
+                        auto range = std::minmax_element(
+                                samples.begin() + first,
+                                samples.begin() + last);
+                        result[i] = {*range.first, *range.second};
+                        continue;
+                }
+                // A few buckets at most, those overlapping the share
+                const auto & buckets = levels_[level];
+                auto k = first / size;
+                auto bucket = buckets[k];
+                for (k++; k * size < last; k++)
+                        bucket = merge(bucket, buckets[k]);
+                result[i] = bucket;
+        }
+        return result;
+}
+}
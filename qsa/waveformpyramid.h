@@ -0,0 +1,64 @@
+/*
+ * Quadratic Sinusoidal Analysis.
+ * Copyright (C) 2018 OpenQSA.
+ * 
+ * This file is part of OpenQSA.
+ * 
+ * OpenQSA is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ * 
+ * OpenQSA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with OpenQSA.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef QSA_WAVEFORMPYRAMID_H
+#define QSA_WAVEFORMPYRAMID_H
+
+#include <cstddef>
+#include <vector>
+
+namespace Qsa
+{
+// Minimum and maximum of a waveform over buckets of 16, 32, 64... samples, so
+// that any range of it can be drawn from about one bucket per pixel, in time
+// linear in the number of pixels whatever the length of the waveform.
+class WaveformPyramid
+{
+public:
+        struct Bucket
+        {
+                double min_{};
+                double max_{};
+        };
+
+        WaveformPyramid() = default;
+        WaveformPyramid(const WaveformPyramid &) = default;
+        WaveformPyramid & operator=(const WaveformPyramid &) = default;
+        ~WaveformPyramid() = default;
+
+        explicit WaveformPyramid(const std::vector<double> & samples);
+
+        // Range of the whole waveform
+        Bucket bounds() const;
+        // Samples [begin, end) in count buckets, samples being those the
+        // pyramid was built from. Buckets may reach a little past their share
+        // of the range, up to the boundaries of the level they come from.
+        std::vector<Bucket> envelope(
+                const std::vector<double> & samples,
+                std::size_t begin,
+                std::size_t end,
+                std::size_t count) const;
+
+private:
+        std::vector<std::vector<Bucket>> levels_;
+};
+}
+
+#endif /* QSA_WAVEFORMPYRAMID_H */
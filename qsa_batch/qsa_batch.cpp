@@ -0,0 +1,316 @@
+/*
+ * Quadratic Sinusoidal Analysis.
+ * Copyright (C) 2018 OpenQSA.
+ * 
+ * This file is part of OpenQSA.
+ * 
+ * OpenQSA is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ * 
+ * OpenQSA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with OpenQSA.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Batch analysis of recordings saved by Qsa::Recorder. Each recording is
+ * summarized by one row of a tab-separated table. Recordings already listed
+ * in the table are skipped, so an interrupted run resumes where it stopped.
+ */
+
+#include "qsa.h"
+
+#include <glob.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+const char * USAGE =
+        "usage: qsa-batch [-j threads] [-k eigenvalues] [-o table] "
+        "directory|pattern ...\n"
+        "\n"
+        "Estimates QSA kernels of every recording (*.json files of\n"
+        "directories, or files matching glob patterns) and appends one row\n"
+        "per recording to the table (default qsa-summary.tsv):\n"
+        "\n"
+        "  file            recording path\n"
+        "  traces          complete traces averaged\n"
+        "  frequencies     generator frequencies (Hz)\n"
+        "  linear_real     linear kernel at each generator, real part\n"
+        "  linear_imag     linear kernel at each generator, imaginary part\n"
+        "  linear_snr      |linear kernel| / standard error, per generator\n"
+        "  quadratic_norm  Frobenius norm of the quadratic matrix\n"
+        "  quadratic_snr   quadratic_norm / norm of standard errors\n"
+        "  eigenvalues     leading eigenvalues of the quadratic matrix\n"
+        "\n"
+        "List columns are comma-separated, NA standing for a ratio that is\n"
+        "unknown, e.g. with a single trace. Recordings already in the table\n"
+        "are skipped.\n";
+
+const char * COLUMNS =
+        "file\ttraces\tfrequencies\tlinear_real\tlinear_imag\tlinear_snr\t"
+        "quadratic_norm\tquadratic_snr\teigenvalues\n";
+
+std::string format(double value)
+{
+        char text[32];
+        std::snprintf(text, sizeof(text), "%.6g", value);
+        return text;
+}
+
+// Signal to noise ratio, NA when the error is unknown, e.g. a single trace
+std::string format_ratio(double value, double error)
+{
+        auto ratio = value / error;
+        return std::isfinite(ratio) ? format(ratio) : "NA";
+}
+
+template <typename Values, typename Function>
+std::string format_list(const Values & values, Function function)
+{
+        std::string result;
+        for (std::size_t i = 0; i < values.size(); i++)
+        {
+                if (i > 0)
+                        result += ',';
+                result += function(i);
+        }
+        return result;
+}
+
+std::string summarize(
+        const std::string & file,
+        const Qsa::Analysis::Kernels & kernels,
+        const Qsa::Eigensolver::Eigenpairs & eigenpairs)
+{
+        double norm = 0;
+        double error = 0;
+        for (std::size_t i = 0; i < kernels.quadratic_.size(); i++)
+        {
+                norm += std::norm(kernels.quadratic_[i]);
+                error += kernels.quadratic_error_[i] *
+                        kernels.quadratic_error_[i];
+        }
+
+        std::ostringstream row;
+        row << file << '\t'
+                << kernels.trace_count_ << '\t'
+                << format_list(kernels.frequencies_, [&](std::size_t i)
+                {
+                        return format(kernels.frequencies_[i]);
+                }) << '\t'
+                << format_list(kernels.linear_, [&](std::size_t i)
+                {
+                        return format(kernels.linear_[i].real());
+                }) << '\t'
+                << format_list(kernels.linear_, [&](std::size_t i)
+                {
+                        return format(kernels.linear_[i].imag());
+                }) << '\t'
+                << format_list(kernels.linear_, [&](std::size_t i)
+                {
+                        return format_ratio(
+                                std::abs(kernels.linear_[i]),
+                                kernels.linear_error_[i]);
+                }) << '\t'
+                << format(std::sqrt(norm)) << '\t'
+                << format_ratio(std::sqrt(norm), std::sqrt(error)) << '\t'
+                << format_list(eigenpairs.values_, [&](std::size_t i)
+                {
+                        return format(eigenpairs.values_[i]);
+                }) << '\n';
+        return row.str();
+}
+
+// Recordings named by a directory or a glob pattern, as canonical paths
+std::vector<std::string> expand(const std::string & operand)
+{
+        namespace fs = std::filesystem;
+        std::vector<std::string> result;
+        std::error_code error;
+        if (fs::is_directory(operand, error))
+        {
+                fs::directory_iterator entry(operand, error);
+                for (; !error && entry != fs::directory_iterator();
+                        entry.increment(error))
+                {
+                        if (entry->is_regular_file(error) &&
+                                entry->path().extension() == ".json")
+                                result.push_back(entry->path());
+                }
+                if (error)
+                        std::cerr << operand << ": " << error.message()
+                                << '\n';
+        }
+        else
+        {
+                glob_t matches;
+                if (glob(operand.c_str(), 0, nullptr, &matches) == 0)
+                {
+                        for (std::size_t i = 0; i < matches.gl_pathc; i++)
+                                result.push_back(matches.gl_pathv[i]);
+                }
+                globfree(&matches);
+        }
+        for (auto & file : result)
+                file = fs::weakly_canonical(file);
+        return result;
+}
+
+// Files already summarized in the table, after the header row. A row cut
+// short by an interrupted run is removed, so its recording is analysed again.
+std::set<std::string> summarized(const std::string & table)
+{
+        std::set<std::string> result;
+        std::ifstream input(table, std::ios::binary);
+        std::string contents(
+                (std::istreambuf_iterator<char>(input)),
+                std::istreambuf_iterator<char>());
+        input.close();
+        auto end = contents.rfind('\n');
+        auto size = end == std::string::npos ? 0 : end + 1;
+        if (size < contents.size())
+                std::filesystem::resize_file(table, size);
+
+        std::istringstream lines(contents.substr(0, size));
+        std::string line;
+        std::getline(lines, line);
+        while (std::getline(lines, line))
+                result.insert(line.substr(0, line.find('\t')));
+        return result;
+}
+}
+
+int main(int argc, char * argv[])
+{
+        std::size_t threads = std::max(1U, std::thread::hardware_concurrency());
+        std::size_t count = 0;
+        std::string table = "qsa-summary.tsv";
+        int option;
+        while ((option = getopt(argc, argv, "j:k:o:h")) != -1)
+        {
+                switch (option)
+                {
+                case 'j':
+                        threads = std::max(1L, std::atol(optarg));
+                        break;
+                case 'k':
+                        count = std::max(0L, std::atol(optarg));
+                        break;
+                case 'o':
+                        table = optarg;
+                        break;
+                default:
+                        std::cerr << USAGE;
+                        return option == 'h' ? 0 : 2;
+                }
+        }
+        if (optind == argc)
+        {
+                std::cerr << USAGE;
+                return 2;
+        }
+
+        std::vector<std::string> files;
+        for (auto i = optind; i < argc; i++)
+        {
+                auto expanded = expand(argv[i]);
+                if (expanded.empty())
+                        std::cerr << argv[i] << ": no recording found\n";
+                files.insert(files.end(), expanded.begin(), expanded.end());
+        }
+        std::sort(files.begin(), files.end());
+        files.erase(std::unique(files.begin(), files.end()), files.end());
+
+        auto done = summarized(table);
+        std::error_code error;
+        auto size = std::filesystem::file_size(table, error);
+        auto fresh = error || size == 0;
+        files.erase(
+                std::remove_if(files.begin(), files.end(), [&](auto & file)
+                {
+                        return done.count(file) > 0;
+                }),
+                files.end());
+        std::ofstream output(table, std::ios::app);
+        if (!output)
+        {
+                std::cerr << table << ": cannot open for writing\n";
+                return 1;
+        }
+        if (fresh)
+                output << COLUMNS << std::flush;
+        std::cerr << done.size() << " recordings already summarized, "
+                << files.size() << " to analyse\n";
+
+        // One task per file, each file being streamed trace by trace so
+        // memory stays bounded whatever the size of recordings
+        Qsa::ThreadPool pool(threads);
+        Qsa::Eigensolver eigensolver(count);
+        std::mutex mutex;
+        std::size_t analysed = 0;
+        std::size_t failures = 0;
+        for (const auto & file : files)
+        {
+                pool.submit([&, file]
+                {
+                        std::string row;
+                        std::string failure;
+                        try
+                        {
+                                auto kernels =
+                                        Qsa::Analysis::estimate_file(
+                                                file,
+                                                pool);
+                                row = summarize(
+                                        file,
+                                        kernels,
+                                        eigensolver.solve(
+                                                kernels.quadratic_,
+                                                kernels.size_));
+                        }
+                        catch (const std::exception & exception)
+                        {
+                                failure = exception.what();
+                        }
+
+                        // Rows are flushed one by one for resuming
+                        std::lock_guard<std::mutex> lock(mutex);
+                        analysed++;
+                        std::cerr << '[' << analysed << '/' << files.size()
+                                << "] " << file;
+                        if (failure.empty())
+                        {
+                                output << row << std::flush;
+                                std::cerr << '\n';
+                        }
+                        else
+                        {
+                                failures++;
+                                std::cerr << ": " << failure << '\n';
+                        }
+                });
+        }
+        pool.wait();
+        return failures > 0 ? 1 : 0;
+}
@@ -26,8 +26,10 @@
 #include "qsa_response.h"
 #include <main_window.h>
 
+#include <algorithm>
 #include <fstream>
 #include <iostream>
+#include <stdexcept>
 
 extern "C"
 Plugin::Object * createRTXIPlugin()
@@ -41,16 +43,87 @@ DefaultGUIModel::variable_t vars[] =
 {
         { "Iqsa", "current", DefaultGUIModel::INPUT},
         { "Vm", "membrane potential", DefaultGUIModel::INPUT},
-        { "Sync", "synchronization", DefaultGUIModel::INPUT}
+        { "Sync", "synchronization", DefaultGUIModel::INPUT},
+        { "Stop", "", DefaultGUIModel::OUTPUT},
+        { "Settled", "", DefaultGUIModel::OUTPUT},
+        { "Iqsa2", "current", DefaultGUIModel::INPUT},
+        { "Vm2", "membrane potential", DefaultGUIModel::INPUT},
+        { "Iqsa3", "current", DefaultGUIModel::INPUT},
+        { "Vm3", "membrane potential", DefaultGUIModel::INPUT},
+        { "Iqsa4", "current", DefaultGUIModel::INPUT},
+        { "Vm4", "membrane potential", DefaultGUIModel::INPUT},
+        {
+                "TargetSNR", "",
+                DefaultGUIModel::PARAMETER | DefaultGUIModel::DOUBLE,
+        },
+        {
+                "TargetWidth", "membrane potential",
+                DefaultGUIModel::PARAMETER | DefaultGUIModel::DOUBLE,
+        },
+        {
+                "SettleThreshold", "membrane potential",
+                DefaultGUIModel::PARAMETER | DefaultGUIModel::DOUBLE,
+        },
+        {
+                "RawStorage", "",
+                DefaultGUIModel::PARAMETER | DefaultGUIModel::INTEGER,
+        },
+        {
+                "OnlineSpectrum", "",
+                DefaultGUIModel::PARAMETER | DefaultGUIModel::INTEGER,
+        },
+        {
+                "Averaging", "",
+                DefaultGUIModel::PARAMETER | DefaultGUIModel::INTEGER,
+        },
+        {
+                "Channel", "",
+                DefaultGUIModel::PARAMETER | DefaultGUIModel::INTEGER,
+        },
+        {
+                "ChannelCount", "",
+                DefaultGUIModel::PARAMETER | DefaultGUIModel::INTEGER,
+        }
 };
 
 std::size_t num_vars = sizeof (vars) / sizeof (DefaultGUIModel::variable_t);
+
+// Inputs Iqsa and Vm, Iqsa2 and Vm2...
+const int MAX_CHANNELS = 4;
+
+// Time shown by the monitor, in ms, and its refresh period
+const double MONITOR_WINDOW = 10000;
+const int MONITOR_REFRESH = 40;
+
+std::string channel_input(const std::string & name, int k)
+{
+        return k == 0 ? name : name + std::to_string(k + 1);
+}
+
+// Recording of channel k next to that of the first one, e.g. cell_2.json
+std::string channel_filename(const std::string & filename, int k)
+{
+        if (k == 0)
+                return filename;
+        auto dot = filename.rfind('.');
+        auto slash = filename.rfind('/');
+        if (dot == std::string::npos ||
+                (slash != std::string::npos && dot < slash))
+                dot = filename.size();
+        return filename.substr(0, dot) + "_" + std::to_string(k + 1) +
+                filename.substr(dot);
+}
 }
 
 QsaResponse::QsaResponse()
 :
         DefaultGUIModel("QsaResponse with Custom GUI", ::vars, ::num_vars)
 {
+        for (auto k = 0; k < MAX_CHANNELS; k++)
+                recorders.emplace_back(new Qsa::Recorder);
+        for (auto i = 0; i < 2 * MAX_CHANNELS; i++)
+                monitorRings.emplace_back(new Qsa::DecimatingRing);
+        monitorTraces.resize(monitorRings.size());
         setWhatsThis(
                 "<p><b>QsaResponse:</b>"
                 "<br>Record response to QSA stimulation</p>");
@@ -61,6 +134,31 @@ QsaResponse::QsaResponse()
         update(INIT);
         refresh();
         QTimer::singleShot(0, this, SLOT(resizeMe()));
+
+        saveTimer = new QTimer(this);
+        QObject::connect(
+                saveTimer,
+                SIGNAL(timeout()),
+                this,
+                SLOT(onTimerSave()));
+
+        // Stimulation published by QsaStimulation is picked up as it changes
+        sharedTimer = new QTimer(this);
+        QObject::connect(
+                sharedTimer,
+                SIGNAL(timeout()),
+                this,
+                SLOT(onTimerShared()));
+        sharedTimer->start(200);
+
+        // Responses are shown as they come, recorded or not
+        monitorTimer = new QTimer(this);
+        QObject::connect(
+                monitorTimer,
+                SIGNAL(timeout()),
+                this,
+                SLOT(onTimerMonitor()));
+        monitorTimer->start(MONITOR_REFRESH);
 }
 
 QsaResponse::~QsaResponse()
@@ -69,43 +167,123 @@ QsaResponse::~QsaResponse()
 
 void QsaResponse::execute()
 {
+        // Buckets only, the GUI drawing them at its own pace
+        for (std::size_t k = 0; k < monitoredChannels; k++)
+        {
+                monitorRings[2 * k]->push(input(indexVm[k]));
+                monitorRings[2 * k + 1]->push(input(indexIqsa[k]));
+        }
+
         if (recording)
         {
-                recorder.push(
-                        input(indexIqsa),
-                        input(indexVm),
-                        input(indexSync));
+                auto sync = input(indexSync);
+                auto should_stop = true;
+                auto settled = true;
+                for (std::size_t k = 0; k < recordedChannels; k++)
+                {
+                        auto & recorder = *recorders[k];
+                        recorder.push(
+                                input(indexIqsa[k]),
+                                input(indexVm[k]),
+                                sync);
+                        should_stop = should_stop && recorder.should_stop();
+                        settled = settled && recorder.settled();
+                }
+                // Tell the stimulation to end once responses are known enough
+                output(indexStop) = should_stop;
+                // Or to measure right away once transients are over
+                output(indexSettled) = settled;
+                // Channels share the same sync, hence start and stop together
+                const auto & recorder = *recorders[0];
                 if (recorder.started() && recorder.stopped())
                 {
                         recording = false;
                         recordButton->setEnabled(true);
                         cancelButton->setEnabled(false);
-                        saveButton->setEnabled(true);
+                        // Or once files being written are, by onTimerSave()
+                        saveButton->setEnabled(!saving);
                 }
         }
 }
 
 void QsaResponse::initParameters()
 {
+        // No target, all traces are recorded
+        TargetSNR = 0;
+        TargetWidth = 0;
+        // Full settling period
+        SettleThreshold = 0;
+        // Every trace is kept, without averages
+        RawStorage = 1;
+        Averaging = 0;
+        // Spectra computed offline from the samples
+        OnlineSpectrum = 0;
+        // Stimulation shared by the QsaStimulation of the same channel
+        Channel = 0;
+        ChannelCount = 1;
 }
 
 void QsaResponse::doModify()
 {
         // Set input indices
-        auto assign = [&](const std::string & name, std::size_t & index)
+        auto assign = [&](
+                const std::string & name,
+                std::size_t & index,
+                IO::flags_t type,
+                std::size_t count)
         {
-                for (std::size_t i = 0; i < 3; i++)
+                for (std::size_t i = 0; i < count; i++)
                 {
-                        if (getName(INPUT, i) == name)
+                        if (getName(type, i) == name)
                         {
                                 index = i;
                                 break;
                         } 
                 }
         };
-        assign("Iqsa", indexIqsa);
-        assign("Vm", indexVm);
-        assign("Sync", indexSync);
+        auto inputs = 2 * MAX_CHANNELS + 1;
+        indexIqsa.resize(MAX_CHANNELS);
+        indexVm.resize(MAX_CHANNELS);
+        for (auto k = 0; k < MAX_CHANNELS; k++)
+        {
+                assign(channel_input("Iqsa", k), indexIqsa[k], INPUT, inputs);
+                assign(channel_input("Vm", k), indexVm[k], INPUT, inputs);
+        }
+        assign("Sync", indexSync, INPUT, inputs);
+        assign("Stop", indexStop, OUTPUT, 2);
+        assign("Settled", indexSettled, OUTPUT, 2);
+
+        // Get parameters, they apply from the next recording on
+        TargetSNR = getParameter("TargetSNR").toDouble();
+        TargetWidth = getParameter("TargetWidth").toDouble();
+        SettleThreshold = getParameter("SettleThreshold").toDouble();
+        RawStorage = getParameter("RawStorage").toInt();
+        OnlineSpectrum = getParameter("OnlineSpectrum").toInt();
+        Averaging = getParameter("Averaging").toInt();
+        Channel = getParameter("Channel").toInt();
+        ChannelCount = getParameter("ChannelCount").toInt();
+        ChannelCount = std::max(1, std::min(ChannelCount, MAX_CHANNELS));
+        for (auto & recorder : recorders)
+        {
+                recorder->set_target_snr(TargetSNR);
+                recorder->set_target_width(TargetWidth);
+                recorder->set_settle_threshold(SettleThreshold);
+                recorder->set_raw_storage(RawStorage != 0);
+                // Without samples, traces are only analysed from the spectrum
+                recorder->set_online_spectrum(
+                        OnlineSpectrum != 0 || RawStorage == 0);
+                recorder->set_averaging(Averaging != 0);
+        }
+        // Channels are shared by QsaStimulation from Channel on
+        sharedStimulations.resize(ChannelCount);
+        for (auto k = 0; k < ChannelCount; k++)
+        {
+                auto & shared = sharedStimulations[k];
+                auto name = Qsa::SharedStimulation::channel_name(Channel + k);
+                if (!shared || shared->name() != name)
+                        shared.reset(new Qsa::SharedStimulation(name));
+        }
+        monitoredChannels = ChannelCount;
         recordButton->setEnabled(true);
 }
 
@@ -116,6 +294,14 @@ void QsaResponse::update(DefaultGUIModel::update_flags_t flag)
         case INIT:
         {
                 period = RT::System::getInstance()->getPeriod() * 1e-6; // ms
+                setParameter("TargetSNR", TargetSNR);
+                setParameter("TargetWidth", TargetWidth);
+                setParameter("SettleThreshold", SettleThreshold);
+                setParameter("RawStorage", RawStorage);
+                setParameter("OnlineSpectrum", OnlineSpectrum);
+                setParameter("Averaging", Averaging);
+                setParameter("Channel", Channel);
+                setParameter("ChannelCount", ChannelCount);
                 break;
         }
 
@@ -134,6 +320,19 @@ void QsaResponse::update(DefaultGUIModel::update_flags_t flag)
         case PERIOD:
         {
                 period = RT::System::getInstance()->getPeriod() * 1e-6; // ms
+                if (!recording)
+                        break;
+                // Traces would go on at another dt than the stimulation
+                // recorded says, which QsaStimulation resamples meanwhile
+                for (std::size_t k = 0; k < recordedChannels; k++)
+                        recorders[k]->stop();
+                recording = false;
+                recordButton->setEnabled(true);
+                cancelButton->setEnabled(false);
+                saveButton->setEnabled(
+                        saveTasks.empty() && recorders[0]->stopped());
+                stimulationEdit->append(
+                        "Recording stopped, the period changed");
                 break;
         }
 
@@ -189,15 +388,42 @@ void QsaResponse::customizeGUI()
         recorderLayout->addWidget(cancelButton);
         recorderLayout->addWidget(saveButton);
 
+        // Save progress
+        saveProgress = new QProgressBar;
+        saveProgress->setRange(0, 100);
+        saveProgress->setValue(0);
+        abortButton = new QPushButton("Abort saving");
+        abortButton->setEnabled(false);
+        QObject::connect(
+                abortButton,
+                SIGNAL(clicked()),
+                this,
+                SLOT(onClickAbortButton()));
+
+        // Save group
+        auto saveGroup = new QGroupBox;
+        auto saveLayout = new QHBoxLayout;
+        saveGroup->setLayout(saveLayout);
+        saveLayout->addWidget(saveProgress);
+        saveLayout->addWidget(abortButton);
+
         // Text edit
         stimulationEdit = new QTextEdit;
         stimulationEdit->setReadOnly(true);
 
+        // Monitor, Vm above Iqsa
+        monitorView = new QGraphicsView;
+        monitorScene = new QGraphicsScene;
+        monitorView->setScene(monitorScene);
+        monitorView->setAlignment(Qt::AlignTop | Qt::AlignLeft);
+
         // Custom layout
         QGridLayout * customlayout = DefaultGUIModel::getLayout();
         customlayout->addWidget(pasteGroup);
         customlayout->addWidget(recorderGroup);
+        customlayout->addWidget(saveGroup);
         customlayout->addWidget(stimulationEdit);
+        customlayout->addWidget(monitorView);
         setLayout(customlayout);
 }
 
@@ -205,10 +431,22 @@ void QsaResponse::onClickPasteButton()
 {
         auto cb = QApplication::clipboard();
         auto encoding = cb->text().toStdString();
-        auto stimulation = Qsa::StimulationConverter::parse(encoding);
-        recorder.set_stimulation(stimulation);
-        auto text = QString::fromStdString(stimulation.to_string());
-        stimulationEdit->setText(text);
+        try
+        {
+                // Parameters only, the waveform is never synthesized here.
+                // The clipboard holds the first channel only.
+                auto stimulation = Qsa::StimulationConverter::parse(encoding);
+                recorders[0]->set_stimulation(stimulation);
+                auto text = QString::fromStdString(stimulation.to_string());
+                stimulationEdit->setText(text);
+        }
+        catch (const std::exception & exception)
+        {
+                // Keep the previous stimulation, tell what is wrong
+                stimulationEdit->setText(QString::fromStdString(
+                        std::string("Invalid stimulation, ") +
+                        exception.what()));
+        }
 }
 
 void QsaResponse::onClickRecordButton()
@@ -216,24 +454,184 @@ void QsaResponse::onClickRecordButton()
         recordButton->setEnabled(false);
         cancelButton->setEnabled(true);
         saveButton->setEnabled(false);
-        recorder.start();
+        recordedChannels = ChannelCount;
+        for (std::size_t k = 0; k < recordedChannels; k++)
+                recorders[k]->start();
         recording = true;
 }
 
 void QsaResponse::onClickSaveButton()
 {
+        if (!saveTasks.empty())
+                return; // Previous files are still being written
         QString filename = QFileDialog::getSaveFileName(
                 this,
                 tr("Save File"),
                 "",
-                tr("Text Files (*.txt)"));
-        if (filename != "")
-                recorder.save(filename.toStdString());
+                tr("JSON Files (*.json)"));
+        if (filename == "")
+                return;
+
+        // Write recordings in background, the next one can start meanwhile
+        saveButton->setEnabled(false);
+        abortButton->setEnabled(true);
+        saveProgress->setValue(0);
+        saving = true;
+        for (std::size_t k = 0; k < recordedChannels; k++)
+                saveTasks.emplace_back(new Qsa::SaveTask(
+                        recorders[k]->recording(),
+                        channel_filename(filename.toStdString(), k)));
+        saveTimer->start(100);
 }
 
 void QsaResponse::onClickCancelButton()
 {
-        recorder.stop();
+        for (std::size_t k = 0; k < recordedChannels; k++)
+                recorders[k]->stop();
         cancelButton->setEnabled(false);
         recordButton->setEnabled(true);
 }
+
+void QsaResponse::onClickAbortButton()
+{
+        for (auto & saveTask : saveTasks)
+                saveTask->cancel();
+        abortButton->setEnabled(false);
+}
+
+void QsaResponse::onTimerSave()
+{
+        if (saveTasks.empty())
+                return;
+        auto progress = 0.0;
+        auto finished = true;
+        auto saved = true;
+        for (const auto & saveTask : saveTasks)
+        {
+                progress += saveTask->progress() / saveTasks.size();
+                finished = finished && saveTask->finished();
+                saved = saved && saveTask->saved();
+        }
+        saveProgress->setValue(static_cast<int>(100 * progress));
+        if (!finished)
+                return;
+        saveTimer->stop();
+        if (!saved)
+                saveProgress->setValue(0);
+        saveTasks.clear();
+        saving = false;
+        abortButton->setEnabled(false);
+        saveButton->setEnabled(!recording && recorders[0]->stopped());
+}
+
+void QsaResponse::onTimerShared()
+{
+        if (recording)
+                return; // Next generation is picked up once stopped
+        try
+        {
+                auto changed = false;
+                for (std::size_t k = 0; k < sharedStimulations.size(); k++)
+                {
+                        Qsa::StimulationDescriptor stimulation;
+                        if (!sharedStimulations[k]->fetch(stimulation))
+                                continue;
+                        recorders[k]->set_stimulation(stimulation);
+                        changed = true;
+                }
+                if (!changed)
+                        return;
+                std::string text;
+                for (std::size_t k = 0; k < sharedStimulations.size(); k++)
+                {
+                        if (sharedStimulations.size() > 1)
+                                text += channel_input("Vm", k) + "\n";
+                        text += recorders[k]->stimulation().to_string();
+                }
+                stimulationEdit->setText(QString::fromStdString(text));
+        }
+        catch (const std::exception & exception)
+        {
+                stimulationEdit->setText(QString::fromStdString(
+                        std::string("Invalid shared stimulation, ") +
+                        exception.what()));
+        }
+}
+
+void QsaResponse::onTimerMonitor()
+{
+        if (monitorScene == nullptr)
+                return;
+
+        // About one bucket per pixel over MONITOR_WINDOW, what was shown
+        // at another scale being dropped
+        auto width = static_cast<std::size_t>(
+                std::max(monitorView->width() - 20, 1));
+        auto decimation = static_cast<std::size_t>(
+                std::max(MONITOR_WINDOW / period / width, 1.));
+        auto rescaled = false;
+        for (auto & ring : monitorRings)
+        {
+                if (ring->decimation() == decimation)
+                        continue;
+                ring->set_decimation(decimation);
+                rescaled = true;
+        }
+        for (std::size_t i = 0; i < monitorRings.size(); i++)
+        {
+                auto & trace = monitorTraces[i];
+                if (rescaled || i >= 2 * monitoredChannels)
+                        trace.clear();
+                monitorRings[i]->pop(trace);
+                if (trace.size() > width)
+                        trace.erase(trace.begin(), trace.end() - width);
+        }
+
+        // Vm in the upper half, Iqsa in the lower one, channels sharing
+        // the same scale, the latest bucket being on the right
+        monitorScene->setSceneRect(monitorView->rect());
+        monitorScene->clear();
+        auto rect = monitorScene->sceneRect();
+        auto height = (rect.height() - 30) / 2;
+        for (std::size_t signal = 0; signal < 2; signal++)
+        {
+                auto min_y = 0.;
+                auto max_y = 0.;
+                auto first = true;
+                for (auto i = signal; i < 2 * monitoredChannels; i += 2)
+                {
+                        for (const auto & bucket : monitorTraces[i])
+                        {
+                                min_y = first ?
+                                        bucket.min_ :
+                                        std::min(min_y, bucket.min_);
+                                max_y = first ?
+                                        bucket.max_ :
+                                        std::max(max_y, bucket.max_);
+                                first = false;
+                        }
+                }
+                if (min_y == max_y)
+                        max_y = min_y + 1;
+                auto top = rect.top() + 10 + signal * (height + 10);
+                auto to_y = [&](double y)
+                {
+                        return top + height * (max_y - y) / (max_y - min_y);
+                };
+                for (auto i = signal; i < 2 * monitoredChannels; i += 2)
+                {
+                        const auto & trace = monitorTraces[i];
+                        auto left = rect.left() + 10 + width - trace.size();
+                        for (std::size_t j = 0; j < trace.size(); j++)
+                        {
+                                monitorScene->addLine(
+                                        left + j,
+                                        to_y(trace[j].max_),
+                                        left + j,
+                                        to_y(trace[j].min_));
+                        }
+                }
+        }
+        monitorView->fitInView(monitorScene->sceneRect());
+        monitorScene->invalidate();
+}
@@ -20,7 +20,9 @@
 
 #include <default_gui_model.h>
 
+#include <atomic>
 #include <fstream>
+#include <memory>
 #include <vector>
 
 #include "../qsa/qsa.h"
@@ -41,16 +43,44 @@ protected:
         virtual void update(DefaultGUIModel::update_flags_t);
 
 private:
+        double TargetSNR;
+        double TargetWidth;
+        double SettleThreshold;
+        int RawStorage;
+        int OnlineSpectrum;
+        int Averaging;
+        int Channel;
+        int ChannelCount;
         double period;
         QPushButton * recordButton;
         QPushButton * cancelButton;
         QPushButton * saveButton;
+        QPushButton * abortButton;
+        QProgressBar * saveProgress;
+        QTimer * saveTimer;
+        QTimer * sharedTimer;
         QTextEdit * stimulationEdit;
-        Qsa::Recorder recorder;
+        // Live Vm and Iqsa, decimated by execute() into monitorRings, Vm and
+        // Iqsa of channel k being 2 * k and 2 * k + 1
+        QTimer * monitorTimer;
+        QGraphicsView * monitorView;
+        QGraphicsScene * monitorScene = nullptr;
+        std::vector<std::unique_ptr<Qsa::DecimatingRing>> monitorRings;
+        std::vector<std::vector<Qsa::DecimatingRing::Bucket>> monitorTraces;
+        std::size_t monitoredChannels{0};
+        // One per channel, fed in the same pass
+        std::vector<std::unique_ptr<Qsa::Recorder>> recorders;
+        std::vector<std::unique_ptr<Qsa::SharedStimulation>> sharedStimulations;
+        std::vector<std::unique_ptr<Qsa::SaveTask>> saveTasks;
+        // While saveTasks run, as execute() may not look at them
+        std::atomic<bool> saving{false};
         bool recording{false};
-        std::size_t indexIqsa;
-        std::size_t indexVm;
-        std::size_t indexSync;
+        std::size_t recordedChannels{1};
+        std::vector<std::size_t> indexIqsa;
+        std::vector<std::size_t> indexVm;
+        std::size_t indexSync{0};
+        std::size_t indexStop{0};
+        std::size_t indexSettled{0};
 
         void initParameters();
         void doModify();
@@ -60,4 +90,8 @@ private slots:
         void onClickRecordButton();
         void onClickSaveButton();
         void onClickCancelButton();
+        void onClickAbortButton();
+        void onTimerSave();
+        void onTimerShared();
+        void onTimerMonitor();
 };
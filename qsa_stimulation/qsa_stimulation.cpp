@@ -29,6 +29,7 @@
 
 #include <algorithm>
 #include <iostream>
+#include <stdexcept>
 
 extern "C"
 Plugin::Object * createRTXIPlugin()
@@ -46,6 +47,21 @@ DefaultGUIModel::variable_t vars[] =
         {
                 "Sync", "", DefaultGUIModel::OUTPUT
         },
+        {
+                "Iqsa2", "A", DefaultGUIModel::OUTPUT
+        },
+        {
+                "Iqsa3", "A", DefaultGUIModel::OUTPUT
+        },
+        {
+                "Iqsa4", "A", DefaultGUIModel::OUTPUT
+        },
+        {
+                "Stop", "", DefaultGUIModel::INPUT
+        },
+        {
+                "Settled", "", DefaultGUIModel::INPUT
+        },
         {
                 "MinFrequency", "Hz",
                 DefaultGUIModel::PARAMETER | DefaultGUIModel::DOUBLE,
@@ -97,18 +113,39 @@ DefaultGUIModel::variable_t vars[] =
         {
                 "TraceAlternance", "",
                 DefaultGUIModel::PARAMETER | DefaultGUIModel::INTEGER,
+        },
+        {
+                "Channel", "",
+                DefaultGUIModel::PARAMETER | DefaultGUIModel::INTEGER,
+        },
+        {
+                "ChannelCount", "",
+                DefaultGUIModel::PARAMETER | DefaultGUIModel::INTEGER,
         }
 };
 
 std::size_t num_vars = sizeof(vars) / sizeof(DefaultGUIModel::variable_t);
 
-long cycle = 0;
+// Outputs Iqsa, Iqsa2...
+const int MAX_CHANNELS = 4;
+
+// Samples shown at the deepest zoom
+const std::size_t MIN_VIEW = 16;
+
+std::string channel_output(int k)
+{
+        return k == 0 ? "Iqsa" : "Iqsa" + std::to_string(k + 1);
+}
 }
 
 QsaStimulation::QsaStimulation()
 :
         DefaultGUIModel("QsaStimulation with Custom GUI", ::vars, ::num_vars)
 {
+        // Nothing to apply until the first stimulation is built
+        stimulation = std::make_shared<Qsa::MultichannelStimulation>();
+        activeStimulation = stimulation.get();
+        usedStimulation = nullptr;
         setWhatsThis(
                 "<p><b>QsaStimulation:</b>"
                 "<br>Signal generator for QSA stimulation.</p>");
@@ -127,6 +164,13 @@ QsaStimulation::QsaStimulation()
                 this,
                 SLOT(onTimerApply()));
         applyTimer->start(100);
+
+        buildTimer = new QTimer(this);
+        QObject::connect(
+                buildTimer,
+                SIGNAL(timeout()),
+                this,
+                SLOT(onTimerBuild()));
 }
 
 QsaStimulation::~QsaStimulation()
@@ -135,13 +179,54 @@ QsaStimulation::~QsaStimulation()
 
 void QsaStimulation::execute()
 {
-        double t = cycle * period / 1000;
-        double qsa_output;
+        // Stimulation published last, flagged as acquired before being used
+        // so that the GUI does not release it meanwhile
+        auto current = activeStimulation.load();
+        if (current != appliedStimulation)
+        {
+                acquiredStimulation = current;
+                while (current != activeStimulation.load())
+                {
+                        current = activeStimulation.load();
+                        acquiredStimulation = current;
+                }
+                // A resampled one carries on from the one applied so far,
+                // still held through usedStimulation, at this very sample
+                auto resuming = current;
+                if (appliedStimulation != nullptr &&
+                        resumingStimulation.compare_exchange_strong(
+                                resuming,
+                                nullptr))
+                        current->resume(*appliedStimulation, tick - tick0);
+                usedStimulation = current;
+                appliedStimulation = current;
+        }
+        auto & active = *current;
+        if (applyRequested.exchange(false))
+        {
+                tick0 = tick;
+                active.apply();
+        }
+
+        double qsa_outputs[MAX_CHANNELS];
         int qsa_sync;
-        stimulation.evaluate(t - t0, qsa_output, qsa_sync);
-        output(indexIqsa) = qsa_output;
+        // Stop request (from QsaResponse) ends the current trace early
+        auto stop = input(indexStop) > 0.5;
+        if (stop && !stopInput)
+                active.request_stop();
+        stopInput = stop;
+        // Settled signal (from QsaResponse) cuts the settling period short
+        auto settled = input(indexSettled) > 0.5;
+        if (settled && !settledInput)
+                active.settle();
+        settledInput = settled;
+        active.evaluate_tick(tick - tick0, qsa_outputs, qsa_sync);
+        auto count = active.channel_count();
+        for (std::size_t k = 0; k < indexIqsa.size(); k++)
+                output(indexIqsa[k]) = k < count ? qsa_outputs[k] : 0;
         output(indexSync) = qsa_sync;
-        cycle++;
+        applying = active.is_applying();
+        tick++;
 }
 
 void QsaStimulation::initParameters()
@@ -159,24 +244,35 @@ void QsaStimulation::initParameters()
         TraceCount = 1;
         TracePause = 1.0;
         TraceAlternance = 1;
+        Channel = 0;
+        ChannelCount = 1;
 }
 
 void QsaStimulation::doModify()
 {
-        // Set output indices
-        auto assign = [&](const std::string & name, std::size_t & index)
+        // Set input and output indices
+        auto assign = [&](
+                const std::string & name,
+                std::size_t & index,
+                IO::flags_t type,
+                std::size_t count)
         {
-                for (std::size_t i = 0; i < 2; i++)
+                for (std::size_t i = 0; i < count; i++)
                 {
-                        if (getName(OUTPUT, i) == name)
+                        if (getName(type, i) == name)
                         {
                                 index = i;
                                 break;
                         } 
                 }
         };
-        assign("Iqsa", indexIqsa);
-        assign("Sync", indexSync);
+        auto outputs = MAX_CHANNELS + 1;
+        indexIqsa.resize(MAX_CHANNELS);
+        for (auto k = 0; k < MAX_CHANNELS; k++)
+                assign(channel_output(k), indexIqsa[k], OUTPUT, outputs);
+        assign("Sync", indexSync, OUTPUT, outputs);
+        assign("Stop", indexStop, INPUT, 2);
+        assign("Settled", indexSettled, INPUT, 2);
 
         // Get parameters
         period = RT::System::getInstance()->getPeriod() * 1e-6; // ms
@@ -193,6 +289,9 @@ void QsaStimulation::doModify()
         TraceCount = getParameter("TraceCount").toInt();
         TracePause = getParameter("TracePause").toDouble();
         TraceAlternance = getParameter("TraceAlternance").toInt();
+        Channel = getParameter("Channel").toInt();
+        ChannelCount = getParameter("ChannelCount").toInt();
+        ChannelCount = std::max(1, std::min(ChannelCount, MAX_CHANNELS));
 
         // Build stimulation
         Qsa::StimulationBuilder stimulation_builder;
@@ -211,21 +310,122 @@ void QsaStimulation::doModify()
                 .set_trace_count(TraceCount)
                 .set_trace_pause(TracePause)
                 .set_trace_alternance(TraceAlternance);
-        stimulation = stimulation_builder.build();
+
+        // Built in background, superseding any build in progress, and only
+        // published once complete
+        stimulationBuilder = stimulation_builder;
+        resampling = false;
+        doRetireBuild();
+        buildTask.reset(new Qsa::BuildTask(stimulation_builder, ChannelCount));
+        copyButton->setEnabled(false);
+        applyButton->setEnabled(false);
+        buildCancelButton->setEnabled(true);
+        buildProgress->setValue(0);
+        buildTimer->start(100);
+}
+
+void QsaStimulation::doPublish(
+        std::shared_ptr<Qsa::MultichannelStimulation> built,
+        bool resampled)
+{
+        // Swap for execute(), which may still be using the previous one
+        retired.push_back(stimulation);
+        stimulation = built;
+        if (resampled)
+                resumingStimulation = stimulation.get();
+        activeStimulation = stimulation.get();
 
         // Make text
-        textEdit->setText(QString::fromStdString(stimulation.to_string()));
+        int count = stimulation->channel_count();
+        std::string text;
+        std::vector<double> fundamentals;
+        std::vector<double> amplitudes;
+        for (auto k = 0; k < count; k++)
+        {
+                const auto & channel = stimulation->channel(k);
+                if (count > 1)
+                        text += channel_output(k) + "\n";
+                text += channel.to_string();
+                const auto & f = channel.frequencies().fundamentals();
+                fundamentals.insert(fundamentals.end(), f.begin(), f.end());
+                const auto & a = channel.amplitudes();
+                amplitudes.insert(amplitudes.end(), a.begin(), a.end());
+        }
+        textEdit->setText(QString::fromStdString(text));
+
+        // Hand channels over to QsaResponse, from Channel on, the clipboard
+        // being the fallback
+        try
+        {
+                sharedStimulations.resize(count);
+                for (auto k = 0; k < count; k++)
+                {
+                        auto & shared = sharedStimulations[k];
+                        auto name = Qsa::SharedStimulation::channel_name(
+                                Channel + k);
+                        if (!shared || shared->name() != name)
+                                shared.reset(new Qsa::SharedStimulation(name));
+                        shared->publish(stimulation->channel(k));
+                }
+        }
+        catch (const std::exception & exception)
+        {
+                textEdit->append(QString::fromStdString(
+                        std::string("Not shared, ") + exception.what()));
+        }
 
-        // Plot
-        doPlot(
-                stimulation.frequencies().fundamentals(),
-                stimulation.amplitudes());
+        // Plot, the whole waveform being previewed
+        doPlot(fundamentals, amplitudes);
+        viewBegin = 0;
+        viewEnd = count > 0 ? stimulation->channel(0).waveform().size() : 0;
+        doPlotWaveform();
 
         // Enable buttons
         copyButton->setEnabled(true);
         applyButton->setEnabled(true);
 }
 
+void QsaStimulation::doResample()
+{
+        auto dt = period / 1000;
+        if (buildTask && !resampling)
+        {
+                // Parameters being built are built for the new period instead
+                stimulationBuilder.set_dt(dt);
+                doRetireBuild();
+                buildTask.reset(
+                        new Qsa::BuildTask(stimulationBuilder, ChannelCount));
+                return;
+        }
+
+        // Otherwise resample the stimulation built last, from its spectrum,
+        // any resampling in progress being outdated
+        doRetireBuild();
+        resampling = false;
+        if (stimulation->channel_count() == 0 ||
+                stimulation->channel(0).frequencies().dt() == dt)
+        {
+                buildTimer->stop();
+                buildCancelButton->setEnabled(false);
+                return;
+        }
+        buildTask.reset(new Qsa::BuildTask(stimulation, dt));
+        resampling = true;
+        buildCancelButton->setEnabled(true);
+        buildProgress->setValue(0);
+        buildTimer->start(100);
+}
+
+void QsaStimulation::doRetireBuild()
+{
+        // Joining the thread could hold up the GUI until it next checks for
+        // cancellation, deep in a search or a synthesis
+        if (!buildTask)
+                return;
+        buildTask->cancel();
+        retiredTasks.push_back(std::move(buildTask));
+}
+
 void QsaStimulation::doPlot(
         const std::vector<double> & x,
         const std::vector<double> & y)
@@ -252,6 +452,57 @@ void QsaStimulation::doPlot(
         scene->invalidate();
 }
 
+void QsaStimulation::doPlotWaveform()
+{
+        waveformScene->setSceneRect(waveformView->rect());
+        waveformScene->clear();
+        if (viewBegin >= viewEnd)
+                return;
+
+        // About one bucket per pixel, whatever the zoom, within the range of
+        // all channels
+        auto rect = waveformScene->sceneRect();
+        auto count = static_cast<std::size_t>(std::max(rect.width() - 20, 1.));
+        auto min_y = 0.;
+        auto max_y = 0.;
+        for (std::size_t k = 0; k < stimulation->channel_count(); k++)
+        {
+                const auto & channel = stimulation->channel(k);
+                auto bounds = channel.envelope(
+                        0,
+                        channel.waveform().size(),
+                        1);
+                min_y = std::min(min_y, bounds.front().min_);
+                max_y = std::max(max_y, bounds.front().max_);
+        }
+        if (min_y == max_y)
+                max_y = min_y + 1;
+        auto to_y = [&](double y)
+        {
+                return rect.top()
+                        + 10
+                        + (rect.height() - 20) * (max_y - y) / (max_y - min_y);
+        };
+        for (std::size_t k = 0; k < stimulation->channel_count(); k++)
+        {
+                auto buckets = stimulation->channel(k).envelope(
+                        viewBegin,
+                        viewEnd,
+                        count);
+                for (std::size_t i = 0; i < buckets.size(); i++)
+                {
+                        auto x = rect.left() + 10 + i;
+                        waveformScene->addLine(
+                                x,
+                                to_y(buckets[i].max_),
+                                x,
+                                to_y(buckets[i].min_));
+                }
+        }
+        waveformView->fitInView(waveformScene->sceneRect());
+        waveformScene->invalidate();
+}
+
 void QsaStimulation::update(DefaultGUIModel::update_flags_t flag)
 {
         switch (flag)
@@ -272,6 +523,8 @@ void QsaStimulation::update(DefaultGUIModel::update_flags_t flag)
                 setParameter("TraceCount", TraceCount);
                 setParameter("TracePause", TracePause);
                 setParameter("TraceAlternance", TraceAlternance);
+                setParameter("Channel", Channel);
+                setParameter("ChannelCount", ChannelCount);
                 break;
         }
 
@@ -290,6 +543,7 @@ void QsaStimulation::update(DefaultGUIModel::update_flags_t flag)
         case PERIOD:
         {
                 period = RT::System::getInstance()->getPeriod() * 1e-6; // ms
+                doResample();
                 break;
         }
 
@@ -303,6 +557,31 @@ void QsaStimulation::resizeEvent(QResizeEvent * event)
         DefaultGUIModel::resizeEvent(event);
         if (scene != nullptr)
                 graphicsView->fitInView(scene->sceneRect());
+        if (waveformScene != nullptr)
+                doPlotWaveform();
+}
+
+void QsaStimulation::wheelEvent(QWheelEvent * event)
+{
+        auto size = stimulation->channel_count() > 0 ?
+                stimulation->channel(0).waveform().size() : 0;
+        if (size == 0 || event->delta() == 0)
+                return;
+
+        // Zoom in or out twice, the sample under the cursor staying put
+        auto width = std::max(waveformView->width() - 20, 1);
+        auto x = waveformView->mapFrom(this, event->pos()).x() - 10;
+        auto fraction = std::min(std::max(double(x) / width, 0.), 1.);
+        auto span = double(viewEnd - viewBegin);
+        auto anchor = viewBegin + fraction * span;
+        span = event->delta() > 0 ? span / 2 : span * 2;
+        span = std::min(std::max(span, double(MIN_VIEW)), double(size));
+        auto begin = std::min(
+                std::max(anchor - fraction * span, 0.),
+                size - span);
+        viewBegin = static_cast<std::size_t>(begin);
+        viewEnd = std::min(viewBegin + static_cast<std::size_t>(span), size);
+        doPlotWaveform();
 }
 
 void QsaStimulation::customizeGUI()
@@ -331,10 +610,26 @@ void QsaStimulation::customizeGUI()
                 this,
                 SLOT(onClickApplyButton()));
 
+        // Build progress
+        buildProgress = new QProgressBar;
+        buildProgress->setRange(0, 100);
+        buildProgress->setValue(0);
+
+        // Cancel build button
+        buildCancelButton = new QPushButton("Cancel build");
+        buildCancelButton->setEnabled(false);
+        QObject::connect(
+                buildCancelButton,
+                SIGNAL(clicked()),
+                this,
+                SLOT(onClickBuildCancelButton()));
+
         // Apply group
         auto applyGroup = new QGroupBox;
         auto applyLayout = new QHBoxLayout;
         applyGroup->setLayout(applyLayout);
+        applyLayout->addWidget(buildProgress);
+        applyLayout->addWidget(buildCancelButton);
         applyLayout->addWidget(applyButton);
 
         // Text edit
@@ -349,12 +644,20 @@ void QsaStimulation::customizeGUI()
         graphicsView->setScene(scene);
         graphicsView->setAlignment(Qt::AlignTop | Qt::AlignLeft);
 
+        // Waveform view, zoomed with the wheel
+        waveformView = new QGraphicsView;
+        waveformView->resize(waveformView->width(), 20);
+        waveformScene = new QGraphicsScene;
+        waveformView->setScene(waveformScene);
+        waveformView->setAlignment(Qt::AlignTop | Qt::AlignLeft);
+
         // Display group
         auto displayGroup = new QGroupBox;
         auto displayLayout = new QVBoxLayout;
         displayGroup->setLayout(displayLayout);
         displayLayout->addWidget(textEdit);
         displayLayout->addWidget(graphicsView);
+        displayLayout->addWidget(waveformView);
 
         // Custom layout
         auto customLayout = DefaultGUIModel::getLayout();
@@ -367,17 +670,91 @@ void QsaStimulation::customizeGUI()
 void QsaStimulation::onClickCopyButton()
 {
         auto clipboard = QApplication::clipboard();
-        auto encoding = Qsa::StimulationConverter::print(stimulation);
+        // First channel only, other ones being shared only
+        auto encoding = Qsa::StimulationConverter::print(
+                stimulation->channel(0));
         clipboard->setText(QString::fromStdString(encoding));
 }
 
 void QsaStimulation::onClickApplyButton()
 {
-        t0 = cycle * period / 1000;
-        stimulation.apply();
+        // From the next tick on
+        applyRequested = true;
+}
+
+void QsaStimulation::onClickBuildCancelButton()
+{
+        // The stimulation built last, if any, stays in place
+        doRetireBuild();
+        resampling = false;
+        buildTimer->stop();
+        buildProgress->setValue(0);
+        buildCancelButton->setEnabled(false);
+        copyButton->setEnabled(stimulation->channel_count() > 0);
 }
 
 void QsaStimulation::onTimerApply()
 {
-        applyButton->setEnabled(!stimulation.is_applying());
+        // Release stimulations that execute() moved on from, or never
+        // picked up
+        auto used = usedStimulation.load();
+        auto acquired = acquiredStimulation.load();
+        retired.erase(
+                std::remove_if(
+                        retired.begin(),
+                        retired.end(),
+                        [&](const auto & previous)
+                        {
+                                auto released = previous.get();
+                                if (released == used || released == acquired)
+                                        return false;
+                                // Its address may be reused
+                                resumingStimulation.compare_exchange_strong(
+                                        released,
+                                        nullptr);
+                                return true;
+                        }),
+                retired.end());
+        // And build tasks whose thread is over
+        retiredTasks.erase(
+                std::remove_if(
+                        retiredTasks.begin(),
+                        retiredTasks.end(),
+                        [](const auto & task)
+                        {
+                                return task->finished();
+                        }),
+                retiredTasks.end());
+        applyButton->setEnabled(
+                !buildTask &&
+                stimulation->channel_count() > 0 &&
+                !applying);
+}
+
+void QsaStimulation::onTimerBuild()
+{
+        if (!buildTask)
+                return;
+        auto synthesis =
+                buildTask->stage() == Qsa::StimulationBuilder::STAGE_SYNTHESIS;
+        buildProgress->setFormat(
+                synthesis ? "Synthesis %p%" : "Intermodulation %p%");
+        buildProgress->setValue(static_cast<int>(100 * buildTask->progress()));
+        if (!buildTask->finished())
+                return;
+        buildTimer->stop();
+        buildCancelButton->setEnabled(false);
+        auto built = buildTask->stimulation();
+        buildTask.reset();
+        auto resampled = resampling;
+        resampling = false;
+        if (!built)
+        {
+                textEdit->setText("Stimulation could not be built");
+                buildProgress->setValue(0);
+                return;
+        }
+        buildProgress->setValue(100);
+        // A resampled one carries on with the trace being applied
+        doPublish(built, resampled);
 }
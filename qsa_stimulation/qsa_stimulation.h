@@ -20,6 +20,10 @@
 
 #include <default_gui_model.h>
 
+#include <atomic>
+#include <memory>
+#include <vector>
+
 #include "../qsa/qsa.h"
 
 class QsaStimulation : public DefaultGUIModel
@@ -37,13 +41,20 @@ public:
 protected:
         virtual void update(DefaultGUIModel::update_flags_t);
         virtual void resizeEvent(QResizeEvent * event);
+        virtual void wheelEvent(QWheelEvent * event);
 
 private:
         void initParameters();
         void doModify();
+        void doPublish(
+                std::shared_ptr<Qsa::MultichannelStimulation> built,
+                bool resampled);
+        void doResample();
+        void doRetireBuild();
         void doPlot(
                 const std::vector<double> & x,
                 const std::vector<double> & y);
+        void doPlotWaveform();
 
         double Amplitude;
         double Duration;
@@ -58,20 +69,60 @@ private:
         int TraceCount;
         double TracePause;
         int TraceAlternance;
+        int Channel;
+        int ChannelCount;
         double period;
-        Qsa::Stimulation stimulation;
+        // Built last, picked up by execute() through activeStimulation, the
+        // previous ones being retired until execute() is done with them.
+        // Only execute() touches the stimulation it applies, resuming it
+        // from the previous one when resampled.
+        std::shared_ptr<Qsa::MultichannelStimulation> stimulation;
+        std::vector<std::shared_ptr<Qsa::MultichannelStimulation>> retired;
+        std::atomic<Qsa::MultichannelStimulation *> activeStimulation;
+        std::atomic<Qsa::MultichannelStimulation *> usedStimulation;
+        std::atomic<Qsa::MultichannelStimulation *> acquiredStimulation{
+                nullptr};
+        std::atomic<Qsa::MultichannelStimulation *> resumingStimulation{
+                nullptr};
+        Qsa::MultichannelStimulation * appliedStimulation = nullptr;
+        std::atomic<bool> applyRequested{false};
+        std::atomic<bool> applying{false};
+        std::unique_ptr<Qsa::BuildTask> buildTask;
+        // Cancelled, until their thread is over
+        std::vector<std::unique_ptr<Qsa::BuildTask>> retiredTasks;
+        // Parameters built last, and whether buildTask only changes dt
+        Qsa::StimulationBuilder stimulationBuilder;
+        bool resampling = false;
+        std::vector<std::unique_ptr<Qsa::SharedStimulation>> sharedStimulations;
         QPushButton * copyButton;
         QPushButton * applyButton;
+        QPushButton * buildCancelButton;
         QTimer * applyTimer;
+        QTimer * buildTimer;
+        QProgressBar * buildProgress;
         QTextEdit * textEdit;
         QGraphicsView * graphicsView;
         QGraphicsScene * scene = nullptr;
-        double t0;
-        std::size_t indexIqsa;
-        std::size_t indexSync;
+        // Waveform preview, of samples [viewBegin, viewEnd)
+        QGraphicsView * waveformView;
+        QGraphicsScene * waveformScene = nullptr;
+        std::size_t viewBegin = 0;
+        std::size_t viewEnd = 0;
+        // Ticks of this instance, since it was loaded and when applying,
+        // known to execute() only
+        long tick = 0;
+        long tick0 = 0;
+        std::vector<std::size_t> indexIqsa;
+        std::size_t indexSync = 0;
+        std::size_t indexStop = 0;
+        std::size_t indexSettled = 0;
+        bool stopInput = false;
+        bool settledInput = false;
 
 private slots:
         void onClickCopyButton();
         void onClickApplyButton();
+        void onClickBuildCancelButton();
         void onTimerApply();
+        void onTimerBuild();
 };